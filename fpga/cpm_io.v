@@ -28,25 +28,34 @@
 // 
 // RISC V  Z80
 // Adr     Adr  Usage                        Read     Write    Notes
-// 0x00 (0)       0  - Console status         Z80     RISC V    
-//        --      1  - Console in             Z80     ---       1 
-//        --      1  - Console out            ---     Z80       2 
+// 0x00 (0)       0  - Console status         Both    ---       10
+//        --      1  - Console in             Z80     ---       10
+//        --      1  - Console out            ---     Z80       9 
 // 0x04 (1)       10 - Drive                  Both    Z80       
 // 0x08 (2)       11 - Track                  Both    Z80       
 // 0x0c (3)       12 - Sector low             Both    Z80       
-// --             13 - Disk command           ---     Z80       2 
+// --             13 - Disk command           ---     Z80       2,5
 // --             13 - Disk command           Z80     ---       
-// ---            14 - Disk status            Z80     RISC V    4 
+// ---            14 - Disk status            Z80     RISC V    4,5
+// 0x10 (4)       -- - Sector cache clear     ---     RISC V    
 // 0x14 (5)       15 - DMA Adr LSB            Both    Z80       
 // 0x18 (6)       16 - DMA Adr MSB            Both    Z80       
 // 0x1c (7)       17 - Sector high            Both    Z80       
+// 0x1d (7)       18 - Sector count           Both    Z80       7
 // --             xx - Other                  Z80               
-// 0x20 (8)       -- - Z80 I/O Adr            RISC V  ---       
+// 0x20 (8)       -- - Z80 I/O Adr            RISC V  ---       8
 // 0x24 (9)       -- - Z80 Out Data           RISC V  ---       
 // 0x28 (10)      -- - Z80 In Data            ---     RISC V    
-// 0x2c (11)      -- - Z80 I/O Status         RISC V  ---       3 
+// 0x2c (11)      -- - Z80 I/O Status         RISC V  RISC V    3,8
 // 0x30 (12)      -- - Font foreground color  RISC V  RISC V    
 // 0x34 (13)      -- - Font background color  RISC V  RISC V    
+// 0x38 (14)      -- - Sector cache data      ---     RISC V    6
+// 0x3c (15)      -- - Sector cache tag/hits  RISC V  RISC V    6
+// 0x40 (16)      -- - Console out FIFO data  RISC V  ---       9
+// 0x44 (17)      -- - Console out FIFO count RISC V  ---       9
+// 0x48 (18)      -- - Console in FIFO data   ---     RISC V    10
+// 0x4c (19)      -- - Console in FIFO count  RISC V  ---       10
+// 0x50 (20)      -- - Trap latency           RISC V  RISC V    11
 // Notes:
 //  1 - Z80 held in wait until RISC V write the data to complete the Z80 I/O 
 //      to the "Z80 In Data" register.
@@ -54,6 +63,44 @@
 //      Z80 In Data register
 //  3 - FSM state, written by hardware
 //  4 - Handled by generic I/O hander
+//  5 - A read command which hits in the sector cache is completed in
+//      hardware: the sector is copied to the DMA address through the Z80's
+//      own memory port while the Z80 is held in wait and the following
+//      status read returns 0 without involving the RISC V.  Misses and
+//      writes are passed to the RISC V as before, writes also invalidate
+//      any cached copy of the sector.
+//  6 - The RISC V fills a cache entry by writing the tag
+//      {drive, track, sector msb, sector lsb} followed by the 128 bytes of
+//      sector data, 4 bytes per write.  The entry becomes valid after the
+//      last data write.  Reading the tag register returns the hit count.
+//  7 - Number of sectors for the multi-sector disk commands, read by the
+//      RISC V as bits 15:8 of the sector high register.
+//  8 - io_irq is asserted while the I/O status is IO_STAT_READ or 
+//      IO_STAT_WRITE.  The time from the start of a trap until the RISC V
+//      first reads the I/O status is measured, see note 11.
+//  9 - Console output is queued in a FIFO and the Z80 continues at once, 
+//      it's only held in wait while the FIFO is full.  Reading the data 
+//      register removes the oldest byte, bit 8 is set if there was one.
+//      io_irq is also asserted while the FIFO isn't empty.
+// 10 - The RISC V queues keyboard input in the console input FIFO.  The
+//      console status is 0xff while the FIFO isn't empty and 0 otherwise,
+//      console input reads take the oldest byte from the FIFO.  The Z80 is
+//      held in wait while reading console input from an empty FIFO.
+//      Bit 9 of the count register is set when the Z80 is waiting for 
+//      input: it's reading console input from an empty FIFO or it has read
+//      the console status 64 times while the FIFO was empty without any
+//      console output in between.  Queuing input clears it.
+// 11 - The longest time from the start of a trap until the RISC V first
+//      read the I/O status in units of 32 clocks, saturating at 0xffff.
+//      Any write clears it.
+
+// Console FIFOs
+// Like the sector cache the FIFOs live in distributed RAM.
+
+// Sector cache
+// The Spartan 3E block RAMs are committed to the Z80 and RISC V memories so 
+// the sector cache is small and lives in distributed RAM.  It is direct 
+// mapped on the low bits of the sector and track numbers.
 
 module cpm_io(
     input wire clk,
@@ -70,10 +117,16 @@ module cpm_io(
 
 // RISC V interface
     input wire io_valid,
-    input wire [23:0] rv_wdata,
-    input wire [3:0] rv_adr,
+    input wire [31:0] rv_wdata,
+    input wire [4:0] rv_adr,
     input wire rv_wstr,
     output reg [23:0] rv_rdata,
+    output wire io_irq,
+// Z80 memory interface for sector cache hits
+    output reg dma_active,
+    output reg dma_mem_wr,
+    output reg [15:0] dma_mem_adr,
+    output reg [7:0] dma_mem_data,
 // vga_mixer interface
     output reg [23:0] font_fg_color,
     output reg [23:0] font_bg_color
@@ -83,31 +136,274 @@ module cpm_io(
     reg [7:0] disk_track;
     reg [7:0] disk_sector_lsb;
     reg [7:0] disk_sector_msb;
+    reg [7:0] disk_sector_count;
     reg [7:0] disk_dma_adr_lsb;
     reg [7:0] disk_dma_adr_msb;
     reg [7:0] io_port_adr;
     reg [7:0] out_port_data;
-    reg [1:0] io_port_status;
-    reg [7:0] console_status;
+    reg [2:0] io_port_status;
 
-    localparam IO_STAT_IDLE  = 2'd0;
-    localparam IO_STAT_WRITE = 2'd1;
-    localparam IO_STAT_READ  = 2'd2;
-    localparam IO_STAT_READY = 2'd3;
+    localparam IO_STAT_IDLE  = 3'd0;
+    localparam IO_STAT_WRITE = 3'd1;
+    localparam IO_STAT_READ  = 3'd2;
+    localparam IO_STAT_READY = 3'd3;
+    localparam IO_STAT_DMA   = 3'd4;
     
     localparam BLACK = 24'd0;
     localparam GREEN = 24'h00ff00;
+
+    localparam COF_BITS = 8;     // 256 byte console output FIFO
+    localparam CIF_BITS = 8;     // 256 byte console input FIFO
+
+    localparam SC_ENTRIES = 8;
+    localparam SC_INDEX_BITS = 3;
+
+    (* ram_style = "distributed" *) reg [7:0] sc_lane_0 [0:SC_ENTRIES*32-1];
+    (* ram_style = "distributed" *) reg [7:0] sc_lane_1 [0:SC_ENTRIES*32-1];
+    (* ram_style = "distributed" *) reg [7:0] sc_lane_2 [0:SC_ENTRIES*32-1];
+    (* ram_style = "distributed" *) reg [7:0] sc_lane_3 [0:SC_ENTRIES*32-1];
+    reg [31:0] sc_tag [0:SC_ENTRIES-1];
+    reg [SC_ENTRIES-1:0] sc_valid;
+    reg [SC_INDEX_BITS-1:0] sc_fill_index;
+    reg [31:0] sc_fill_tag;
+    reg [4:0] sc_fill_word;
+    reg sc_filling;
+    reg [23:0] sc_hits;
+    reg disk_status_hw;
+    reg [6:0] dma_count;
+    reg io_valid_last;
+    (* ram_style = "distributed" *) reg [7:0] cof_mem [0:(1<<COF_BITS)-1];
+    reg [COF_BITS-1:0] cof_wr_ptr;
+    reg [COF_BITS-1:0] cof_rd_ptr;
+    reg [COF_BITS:0] cof_count;
+    (* ram_style = "distributed" *) reg [7:0] cif_mem [0:(1<<CIF_BITS)-1];
+    reg [CIF_BITS-1:0] cif_wr_ptr;
+    reg [CIF_BITS-1:0] cif_rd_ptr;
+    reg [CIF_BITS:0] cif_count;
+    reg cif_wanted;         // the Z80 is waiting for console input
+    reg [5:0] cif_polls;    // empty status reads since the last output
+    reg trap_seen;          // RISC V has read the status of the pending trap
+    reg [4:0] trap_prescale;
+    reg [15:0] trap_wait;
+    reg [15:0] trap_wait_max;
+
+    wire trap_pending = io_port_status == IO_STAT_READ || 
+                        io_port_status == IO_STAT_WRITE;
+    wire cof_full = cof_count[COF_BITS];
+    wire cof_push = z80_iowr && z80adr == 8'd1 && 
+                    io_port_status == IO_STAT_IDLE && !cof_full;
+    wire cof_pop = io_valid && !io_valid_last && !rv_wstr && 
+                   rv_adr == 5'd16 && cof_count != 0;
+    assign io_irq = trap_pending || cof_count != 0;
+    wire [7:0] console_status = cif_count != 0 ? 8'hff : 8'h00;
+    wire cif_push = io_valid && !io_valid_last && rv_wstr && 
+                    rv_adr == 5'd18 && !cif_count[CIF_BITS];
+    wire cif_pop = z80_iord && z80adr == 8'd1 && 
+                   io_port_status == IO_STAT_IDLE && cif_count != 0;
+
+    // io_valid is asserted for two clocks, only act once on cache writes
+    wire sc_rv_wr = io_valid && !io_valid_last && rv_wstr;
+
+    wire [31:0] sc_lookup_tag = 
+        {disk_drive, disk_track, disk_sector_msb, disk_sector_lsb};
+    wire [SC_INDEX_BITS-1:0] sc_lookup_index = 
+        disk_sector_lsb[SC_INDEX_BITS-1:0] ^ disk_track[SC_INDEX_BITS-1:0];
+    wire sc_hit = sc_valid[sc_lookup_index] && 
+                  sc_tag[sc_lookup_index] == sc_lookup_tag;
+    wire [SC_INDEX_BITS+4:0] sc_rd_adr = {sc_lookup_index, dma_count[6:2]};
+    wire [7:0] sc_rd_data = 
+        dma_count[1:0] == 2'd0 ? sc_lane_0[sc_rd_adr] : (
+        dma_count[1:0] == 2'd1 ? sc_lane_1[sc_rd_adr] : (
+        dma_count[1:0] == 2'd2 ? sc_lane_2[sc_rd_adr] : sc_lane_3[sc_rd_adr]));
+    wire [SC_INDEX_BITS+4:0] sc_wr_adr = {sc_fill_index, sc_fill_word};
+    wire sc_wr = sc_rv_wr && rv_adr == 4'd14 && sc_filling;
+
+    always@(posedge clk) begin
+        io_valid_last <= io_valid;
+        if (sc_wr) begin
+            sc_lane_0[sc_wr_adr] <= rv_wdata[7:0];
+            sc_lane_1[sc_wr_adr] <= rv_wdata[15:8];
+            sc_lane_2[sc_wr_adr] <= rv_wdata[23:16];
+            sc_lane_3[sc_wr_adr] <= rv_wdata[31:24];
+        end
+    end
+
+    // Console output FIFO
+    always@(posedge clk) begin
+        if (cof_push)
+            cof_mem[cof_wr_ptr] <= z80do;
+    end
+
+    always@(posedge clk) begin
+        if (reset) begin
+            cof_wr_ptr <= 0;
+            cof_rd_ptr <= 0;
+            cof_count <= 0;
+        end
+        else begin
+            if (cof_push)
+                cof_wr_ptr <= cof_wr_ptr + 1'b1;
+            if (cof_pop)
+                cof_rd_ptr <= cof_rd_ptr + 1'b1;
+            if (cof_push && !cof_pop)
+                cof_count <= cof_count + 1'b1;
+            else if (cof_pop && !cof_push)
+                cof_count <= cof_count - 1'b1;
+        end
+    end
+
+    // Console input FIFO
+    always@(posedge clk) begin
+        if (cif_push)
+            cif_mem[cif_wr_ptr] <= rv_wdata[7:0];
+    end
+
+    always@(posedge clk) begin
+        if (reset) begin
+            cif_wr_ptr <= 0;
+            cif_rd_ptr <= 0;
+            cif_count <= 0;
+            cif_wanted <= 0;
+            cif_polls <= 6'd0;
+        end
+        else begin
+            if (cif_push) begin
+                cif_wanted <= 0;
+                cif_polls <= 6'd0;
+            end
+            else if (z80_iowr && z80adr == 8'd1)
+                cif_polls <= 6'd0;
+            else if (z80_iord && cif_count == 0) begin
+                if (z80adr == 8'd1)
+                    cif_wanted <= 1;
+                else if (z80adr == 8'd0 && io_port_status == IO_STAT_IDLE) begin
+                    if (cif_polls == 6'd63)
+                        cif_wanted <= 1;
+                    else
+                        cif_polls <= cif_polls + 1'b1;
+                end
+            end
+            if (cif_push)
+                cif_wr_ptr <= cif_wr_ptr + 1'b1;
+            if (cif_pop)
+                cif_rd_ptr <= cif_rd_ptr + 1'b1;
+            if (cif_push && !cif_pop)
+                cif_count <= cif_count + 1'b1;
+            else if (cif_pop && !cif_push)
+                cif_count <= cif_count - 1'b1;
+        end
+    end
+
+    // Trap latency measurement
+    always@(posedge clk) begin
+        if (reset) begin
+            trap_seen <= 0;
+            trap_prescale <= 5'd0;
+            trap_wait <= 16'd0;
+            trap_wait_max <= 16'd0;
+        end
+        else begin
+            if (!trap_pending) begin
+                trap_seen <= 0;
+                trap_prescale <= 5'd0;
+                trap_wait <= 16'd0;
+            end
+            else if (!trap_seen) begin
+                if (io_valid && !rv_wstr && rv_adr == 4'd11) begin
+                    trap_seen <= 1;
+                    if (trap_wait > trap_wait_max)
+                        trap_wait_max <= trap_wait;
+                end
+                else begin
+                    trap_prescale <= trap_prescale + 1'b1;
+                    if (trap_prescale == 5'd31 && trap_wait != 16'hffff)
+                        trap_wait <= trap_wait + 1'b1;
+                end
+            end
+            if (sc_rv_wr && rv_adr == 5'd20)
+                trap_wait_max <= 16'd0;
+        end
+    end
+
+    always@(posedge clk) begin
+        if (reset) begin
+            sc_valid <= 0;
+            sc_filling <= 0;
+            sc_hits <= 24'd0;
+            disk_status_hw <= 0;
+            dma_active <= 0;
+            dma_mem_wr <= 0;
+            dma_count <= 7'd0;
+        end
+        else begin
+        // RISC V cache fills
+            if (sc_rv_wr) begin
+                case (rv_adr)
+                    4'd4: begin
+                        sc_valid <= 0;
+                        sc_filling <= 0;
+                    end
+                    4'd14: if (sc_filling) begin
+                        sc_fill_word <= sc_fill_word + 1'b1;
+                        if (sc_fill_word == 5'd31) begin
+                            sc_tag[sc_fill_index] <= sc_fill_tag;
+                            sc_valid[sc_fill_index] <= 1;
+                            sc_filling <= 0;
+                        end
+                    end
+                    4'd15: begin
+                        sc_fill_tag <= rv_wdata;
+                        sc_fill_index <= rv_wdata[SC_INDEX_BITS-1:0] ^ 
+                                         rv_wdata[SC_INDEX_BITS+15:16];
+                        sc_valid[rv_wdata[SC_INDEX_BITS-1:0] ^ 
+                                 rv_wdata[SC_INDEX_BITS+15:16]] <= 0;
+                        sc_fill_word <= 5'd0;
+                        sc_filling <= 1;
+                    end
+                endcase
+            end
+
+        // Z80 disk commands
+            dma_mem_wr <= 0;
+            if (dma_active) begin
+                dma_mem_adr <= {disk_dma_adr_msb, disk_dma_adr_lsb} + dma_count;
+                dma_mem_data <= sc_rd_data;
+                dma_mem_wr <= 1;
+                dma_count <= dma_count + 1'b1;
+                if (dma_count == 7'd127) begin
+                    dma_active <= 0;
+                    sc_hits <= sc_hits + 1'b1;
+                end
+            end
+            else if (z80_iowr && z80adr == 8'd13 && io_port_status == IO_STAT_IDLE) begin
+                if (z80do == 8'd0 && sc_hit) begin
+                    dma_active <= 1;
+                    dma_count <= 7'd0;
+                    disk_status_hw <= 1;
+                end
+                else begin
+                    // Write commands have bit 0 set
+                    if (z80do[0] && sc_hit) begin
+                        sc_valid[sc_lookup_index] <= 0;
+                        if (sc_filling && sc_fill_index == sc_lookup_index)
+                            sc_filling <= 0;
+                    end
+                    disk_status_hw <= 0;
+                end
+            end
+        end
+    end
         
     always@(posedge clk) begin
         if (reset) begin
             io_port_status <= IO_STAT_IDLE;
-            console_status <= 8'd0;
             disk_drive <= 8'd0;
             disk_track <= 8'd0;
             disk_sector_lsb <= 8'd0;
             disk_dma_adr_lsb <= 8'd0;
             disk_dma_adr_msb <= 8'd0;
             disk_sector_msb <= 8'd0;
+            disk_sector_count <= 8'd1;
             io_port_adr <= 8'd0;
             z80di <= 8'd0;
             font_fg_color <= GREEN;
@@ -117,7 +413,6 @@ module cpm_io(
             if (io_valid) begin
                  if (rv_wstr != 0) begin
                     case (rv_adr)
-                        4'd0: console_status <= rv_wdata[7:0];
                         4'd1: disk_drive <= rv_wdata[7:0];
                         4'd2: disk_track <= rv_wdata[7:0];
                         4'd3: disk_sector_lsb <= rv_wdata[7:0];
@@ -129,11 +424,11 @@ module cpm_io(
                            // synthesis translate_off
                            $display("riscv wrote Z80 input data 0x%02x", rv_wdata);
                            // synthesis translate_on
-                            z80di <= rv_wdata;
+                            z80di <= rv_wdata[7:0];
                             io_port_status <= IO_STAT_READY;
                         end
-                        4'd12: font_fg_color <= rv_wdata;
-                        4'd13: font_bg_color <= rv_wdata;
+                        4'd12: font_fg_color <= rv_wdata[23:0];
+                        4'd13: font_bg_color <= rv_wdata[23:0];
                     endcase
                  end
                  else begin
@@ -144,7 +439,7 @@ module cpm_io(
                         4'd3: rv_rdata <= {16'd0, disk_sector_lsb};
                         4'd5: rv_rdata <= {16'd0, disk_dma_adr_lsb};
                         4'd6: rv_rdata <= {16'd0, disk_dma_adr_msb};
-                        4'd7: rv_rdata <= {16'd0, disk_sector_msb};
+                        4'd7: rv_rdata <= {8'd0, disk_sector_count, disk_sector_msb};
                         4'd8: rv_rdata <= {16'd0, io_port_adr};
                         4'd9: begin
                             // synthesis translate_off
@@ -153,9 +448,17 @@ module cpm_io(
                             rv_rdata <= {16'd0, out_port_data};
                             io_port_status <= IO_STAT_READY;
                         end
-                        4'd11: rv_rdata <= {z80hlt, 21'd0, io_port_status};
+                        4'd11: rv_rdata <= {z80hlt, 20'd0, io_port_status};
                         4'd12: rv_rdata <= font_fg_color;
                         4'd13: rv_rdata <= font_bg_color;
+                        4'd15: rv_rdata <= sc_hits;
+                        // io_valid lasts two clocks, return the byte popped
+                        // on the first
+                        5'd16: if (!io_valid_last)
+                            rv_rdata <= {15'd0, cof_count != 0, cof_mem[cof_rd_ptr]};
+                        5'd17: rv_rdata <= {15'd0, cof_count};
+                        5'd19: rv_rdata <= {14'd0, cif_wanted, cif_count};
+                        5'd20: rv_rdata <= {8'd0, trap_wait_max};
                         default: rv_rdata <= 24'd0;
                     endcase
                  end
@@ -166,6 +469,10 @@ module cpm_io(
                         z80di <= console_status;
                         io_port_status <= IO_STAT_READY;
                      end
+                     8'd1: if (cif_pop) begin
+                        z80di <= cif_mem[cif_rd_ptr];
+                        io_port_status <= IO_STAT_READY;
+                     end
                      8'd10: begin
                         z80di <= disk_drive;
                         io_port_status <= IO_STAT_READY;
@@ -190,6 +497,18 @@ module cpm_io(
                         z80di <= disk_sector_msb;
                         io_port_status <= IO_STAT_READY;
                      end
+                     8'd18: begin
+                        z80di <= disk_sector_count;
+                        io_port_status <= IO_STAT_READY;
+                     end
+                     8'd14: if (disk_status_hw) begin
+                        z80di <= 8'd0;
+                        io_port_status <= IO_STAT_READY;
+                     end
+                     else if (io_port_status == IO_STAT_IDLE) begin
+                         io_port_adr <= z80adr;
+                         io_port_status <= IO_STAT_READ;
+                     end
                      default: if (io_port_status == IO_STAT_IDLE) begin
                         // synthesis translate_off
                         $display("Z80 input port 0x%02x", z80adr);
@@ -201,6 +520,10 @@ module cpm_io(
              end
              else if (z80_iowr) begin
                  case (z80adr)
+                     8'd1: if (io_port_status == IO_STAT_IDLE && !cof_full) begin
+                        // queued by cof_push
+                        io_port_status <= IO_STAT_READY;
+                     end
                      8'd10: begin
                         disk_drive <= z80do;
                         io_port_status <= IO_STAT_READY;
@@ -225,6 +548,24 @@ module cpm_io(
                         disk_sector_msb <= z80do;
                         io_port_status <= IO_STAT_READY;
                      end
+                     8'd18: begin
+                        disk_sector_count <= z80do;
+                        io_port_status <= IO_STAT_READY;
+                     end
+                     8'd13: if (io_port_status == IO_STAT_IDLE && !dma_active) begin
+                        if (z80do == 8'd0 && sc_hit) begin
+                        // Sector cache hit, wait for the copy to complete
+                            io_port_status <= IO_STAT_DMA;
+                        end
+                        else begin
+                            io_port_status <= IO_STAT_WRITE;
+                            io_port_adr <= z80adr;
+                            out_port_data <= z80do;
+                        end
+                     end
+                     else if (io_port_status == IO_STAT_DMA && !dma_active) begin
+                        io_port_status <= IO_STAT_READY;
+                     end
                      default: if (io_port_status == IO_STAT_IDLE) begin
                          // synthesis translate_off
                          $display("Z80 output 0x%02x to port 0x%02x",z80do,z80adr);
@@ -0,0 +1,206 @@
+`timescale 1ns / 1ps
+
+// Descriptor driven DMA engine for the RISC V bus
+// Copyright (C) 2020  Skip Hansen
+
+//  This program is free software; you can redistribute it and/or modify it
+//  under the terms and conditions of the GNU General Public License,
+//  version 2, as published by the Free Software Foundation.
+//
+//  This program is distributed in the hope it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//  more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with this program; if not, write to the Free Software Foundation, Inc.,
+//  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+
+// The engine is a second master on the PicoRV32 memory bus so it can copy
+// between anything the CPU can address: the USB 32 bit window, the LPDDR,
+// the packed Z80 RAM window and the internal RAM.  Transfers are 32 bits
+// wide, addresses and lengths must be multiples of 4.
+//
+// Registers (reg_adr):
+//   0 SRC    source address
+//   1 DST    destination address
+//   2 LEN    length in bytes, reads back the bytes remaining
+//   3 CTRL   W: bit 0 start, bit 1 chain, bit 2 interrupt enable.
+//               Any write clears done.
+//            R: bit 0 busy, bit 1 done, bit 2 interrupt enable
+//   4 DESC   address of the first descriptor for chained transfers,
+//            reads back the address of the current descriptor
+//
+// A chained transfer loads SRC, DST, LEN and the address of the next
+// descriptor from the 4 words at DESC and then continues with the next
+// descriptor until a next address of zero is found.  Register writes are
+// ignored while a transfer is in progress.
+//
+// The master port follows the PicoRV32 native interface with the
+// exception that m_addr is valid one clock before m_valid is asserted
+// (it doubles as the look ahead address for the bus decode).
+
+module dma_engine (
+    input wire clk,
+    input wire rst,
+    // register interface
+    input wire reg_valid,
+    input wire [2:0] reg_adr,
+    input wire [31:0] reg_wdata,
+    input wire reg_wstr,
+    output wire [31:0] reg_rdata,
+    // bus master interface
+    output wire m_req,
+    output reg m_valid,
+    output reg [31:0] m_addr,
+    output reg [31:0] m_wdata,
+    output reg [3:0] m_wstrb,
+    input wire [31:0] m_rdata,
+    input wire m_ready,
+    input wire bus_ready,
+    output wire irq
+);
+
+    localparam STATE_IDLE = 2'd0;
+    localparam STATE_DESC = 2'd1;
+    localparam STATE_READ = 2'd2;
+    localparam STATE_WRITE = 2'd3;
+
+    reg [1:0] state;
+    reg setup;              // m_addr presented, m_valid not yet asserted
+    reg [31:0] src;
+    reg [31:0] dst;
+    reg [23:0] len;
+    reg [31:0] desc;
+    reg [31:0] next_desc;
+    reg [1:0] desc_word;
+    reg chain;
+    reg irq_en;
+    reg done;
+
+    assign m_req = state != STATE_IDLE;
+    assign irq = done && irq_en;
+
+    assign reg_rdata =
+        reg_adr == 3'd0 ? src : (
+        reg_adr == 3'd1 ? dst : (
+        reg_adr == 3'd2 ? {8'd0, len} : (
+        reg_adr == 3'd3 ? {29'd0, irq_en, done, m_req} : (
+        reg_adr == 3'd4 ? desc : 32'd0))));
+
+    // Present the address of the next access and wait for the previous
+    // slave to drop ready before asserting m_valid
+    task start_access;
+        input [31:0] adr;
+        input write;
+        begin
+            m_addr <= adr;
+            m_wstrb <= write ? 4'b1111 : 4'b0000;
+            setup <= 1'b1;
+        end
+    endtask
+
+    always @(posedge clk) begin
+        if (rst) begin
+            state <= STATE_IDLE;
+            m_valid <= 1'b0;
+            m_wstrb <= 4'b0000;
+            setup <= 1'b0;
+            chain <= 1'b0;
+            irq_en <= 1'b0;
+            done <= 1'b0;
+            len <= 24'd0;
+        end
+        else begin
+            if (reg_valid && reg_wstr && state == STATE_IDLE) begin
+                case (reg_adr)
+                    3'd0: src <= reg_wdata;
+                    3'd1: dst <= reg_wdata;
+                    3'd2: len <= reg_wdata[23:0];
+                    3'd3: begin
+                        done <= 1'b0;
+                        chain <= reg_wdata[1];
+                        irq_en <= reg_wdata[2];
+                        if (reg_wdata[0]) begin
+                            if (reg_wdata[1]) begin
+                                desc_word <= 2'd0;
+                                start_access(desc,1'b0);
+                                state <= STATE_DESC;
+                            end
+                            else if (len[23:2] != 0) begin
+                                start_access(src,1'b0);
+                                state <= STATE_READ;
+                            end
+                            else
+                                done <= 1'b1;
+                        end
+                    end
+                    3'd4: desc <= reg_wdata;
+                endcase
+            end
+
+            if (setup) begin
+                if (!bus_ready) begin
+                    setup <= 1'b0;
+                    m_valid <= 1'b1;
+                end
+            end
+            else if (m_valid && m_ready) begin
+                m_valid <= 1'b0;
+                case (state)
+                    STATE_DESC: begin
+                        desc_word <= desc_word + 2'd1;
+                        case (desc_word)
+                            2'd0: src <= m_rdata;
+                            2'd1: dst <= m_rdata;
+                            2'd2: len <= m_rdata[23:0];
+                            2'd3: next_desc <= m_rdata;
+                        endcase
+                        if (desc_word != 2'd3)
+                            start_access(desc + {desc_word + 2'd1,2'b00},1'b0);
+                        else if (len[23:2] != 0) begin
+                            start_access(src,1'b0);
+                            state <= STATE_READ;
+                        end
+                        else if (m_rdata != 32'd0) begin
+                            // Empty descriptor, on to the next one
+                            desc <= m_rdata;
+                            desc_word <= 2'd0;
+                            start_access(m_rdata,1'b0);
+                        end
+                        else begin
+                            done <= 1'b1;
+                            state <= STATE_IDLE;
+                        end
+                    end
+                    STATE_READ: begin
+                        m_wdata <= m_rdata;
+                        src <= src + 32'd4;
+                        start_access(dst,1'b1);
+                        state <= STATE_WRITE;
+                    end
+                    STATE_WRITE: begin
+                        dst <= dst + 32'd4;
+                        len <= len - 24'd4;
+                        if (len[23:2] != 1) begin
+                            start_access(src,1'b0);
+                            state <= STATE_READ;
+                        end
+                        else if (chain && next_desc != 32'd0) begin
+                            desc <= next_desc;
+                            desc_word <= 2'd0;
+                            start_access(next_desc,1'b0);
+                            state <= STATE_DESC;
+                        end
+                        else begin
+                            m_wstrb <= 4'b0000;
+                            done <= 1'b1;
+                            state <= STATE_IDLE;
+                        end
+                    end
+                endcase
+            end
+        end
+    end
+
+endmodule
@@ -260,14 +260,28 @@ module pano_top(
     wire z80_mem_wr = !z80_MREQ_n && !z80_WR_n;
     wire z80_mem_rd = (!z80_MREQ_n || !z80_M1_n) && !z80_RD_n;
     wire z80_ram_valid;
+    wire z80_ram32_valid;
     wire z80_io_valid;
     wire [7:0] z80ram_do;
     wire [7:0] z80ram_do_b;
+    wire [31:0] z80ram_do_w;
     wire [23:0] z80io_rdata;
     wire [3:0] mem_wstrb;
     wire [31:0] mem_addr;
     wire [31:0] mem_wdata;
 
+    // cpm_io copies sector cache hits into Z80 RAM through port A while the
+    // Z80 is held in wait
+    wire dma_active;
+    wire dma_mem_wr;
+    wire [15:0] dma_mem_adr;
+    wire [7:0] dma_mem_data;
+    // (dma_mem_wr outlasts dma_active by one clock for the last byte)
+    wire z80ram_dma = dma_active || dma_mem_wr;
+    wire z80ram_wea = z80ram_dma ? dma_mem_wr : z80_mem_wr;
+    wire [15:0] z80ram_addra = z80ram_dma ? dma_mem_adr : z80adr;
+    wire [7:0] z80ram_dina = z80ram_dma ? dma_mem_data : z80do;
+
 `ifdef Z80_RAM_2K
     // RAMB16_S9_S9: Spartan-3/3E/3A/3AN/3AD 2k x 8 + 1 Parity bit Dual-Port RAM
     // Xilinx HDL Libraries Guide, version 11.2
@@ -285,11 +299,11 @@ module pano_top(
     .DOB(z80ram_do_b), // Port B 8-bit Data Output
     // .DOPA(DOPA), // Port A 1-bit Parity Output
     // .DOPB(DOPB), // Port B 1-bit Parity Output
-    .ADDRA(z80adr[10:0]), // Port A 11-bit Address Input
+    .ADDRA(z80ram_addra[10:0]), // Port A 11-bit Address Input
     .ADDRB(mem_addr[12:2]), // Port B 11-bit Address Input
     .CLKA(clk_z80), // Port A Clock
     .CLKB(clk_rv), // Port B Clock
-    .DIA(z80do), // Port A 8-bit Data Input
+    .DIA(z80ram_dina), // Port A 8-bit Data Input
     .DIB(mem_wdata[7:0]), // Port B 8-bit Data Input
     .DIPA(1'b0), // Port A 1-bit parity Input
     .DIPB(1'b0), // Port-B 1-bit parity Input
@@ -297,24 +311,37 @@ module pano_top(
     .ENB(1'b1), // Port B RAM Enable Input
     .SSRA(1'b0), // Port A Synchronous Set/Reset Input
     .SSRB(1'b0), // Port B Synchronous Set/Reset Input
-    .WEA(z80_mem_wr), // Port A Write Enable Input
+    .WEA(z80ram_wea), // Port A Write Enable Input
     .WEB(z80_ram_valid ? mem_wstrb[0] : 1'b0) // Port B Write Enable Input
     );
+    // The packed window isn't supported in the 2K test build
+    assign z80ram_do_w = 32'h0;
 `else
-    z80_mem z80_mem(
+    // The RISC V sees the Z80 RAM through two windows:
+    //   0x05000000: one Z80 byte per 32 bit word (byte at Z80 adr << 2)
+    //   0x05100000: packed, 4 Z80 bytes per 32 bit word
+    wire [3:0] z80ram_web =
+        z80_ram32_valid ? mem_wstrb : (
+        z80_ram_valid && mem_wstrb[0] ? (4'b0001 << mem_addr[3:2]) : 4'b0000);
+    wire [13:0] z80ram_addrb = z80_ram32_valid ? mem_addr[15:2] : mem_addr[17:4];
+    wire [31:0] z80ram_dinb = z80_ram32_valid ? mem_wdata : {4{mem_wdata[7:0]}};
+
+    z80_mem32 z80_mem(
      // Z80 interface
         .clka(clk_z80),
-        .wea(z80_mem_wr),
-        .addra(z80adr),
-        .dina(z80do),
+        .wea(z80ram_wea),
+        .addra(z80ram_addra),
+        .dina(z80ram_dina),
         .douta(z80ram_do),
      // RISC V interface
         .clkb(clk_rv),
-        .web(z80_ram_valid ? mem_wstrb[0] : 1'b0),
-        .addrb(mem_addr[17:2]),
-        .dinb(mem_wdata[7:0]),
-        .doutb(z80ram_do_b)
+        .web(z80ram_web),
+        .addrb(z80ram_addrb),
+        .dinb(z80ram_dinb),
+        .doutb(z80ram_do_w)
     );
+
+    assign z80ram_do_b = z80ram_do_w >> {mem_addr[3:2],3'b000};
 `endif
 
     assign z80di = !z80_IORQ_n ? z80_io_read_data : z80ram_do;
@@ -544,8 +571,11 @@ module pano_top(
     // 03000000 - 03000100 GPIO          See description below
     // 03000100 - 03000100 UART          (4B)
     // 03000200 - 030002FF Z80 I/O       (256B)
-    // 04000000 - 04080000 USB           (512KB)
+    // 03000300 - 0300031F DMA engine    (32B, see dma_engine.v)
+    // 04000000 - 0403FFFF USB           (16 bit ISP1760 access)
+    // 04040000 - 0404FFFF USB           (32 bit ISP1760 access, prefetching)
     // 05000000 - 0503FFFF Z80 RAM       (256KB, data in low byte only)
+    // 05100000 - 0510FFFF Z80 RAM       (64KB, packed 4 bytes per word)
     // 08000000 - 08000FFF Video RAM     (4KB)
     // 0C000000 - 0CFFFFFF LPDDR SDRAM   (16MB)
     // 0E000000 - 0E01FFFF SPI Flash     (128KB, mapped from Flash 768K - 896K)
@@ -562,14 +592,78 @@ module pano_top(
     wire [31:0] mem_la_addr;
     
     reg cpu_irq;
+    wire dma_irq;
+    wire z80_io_irq;
+    
+    // ISP1760 interrupt, active low level (INTR_POL and INTR_LEVEL are left
+    // at their defaults in HW_MODE_CONTROL)
+    reg [1:0] usb_irq_sync;
+    always @(posedge clk_rv)
+        usb_irq_sync <= {usb_irq_sync[0], !USB_IRQ};
+    wire usb_irq = usb_irq_sync[1];
+    
+    // The bus is shared by the CPU and the DMA engine.  Ownership changes
+    // only at the end of a transfer and is followed by a settle cycle with
+    // mem_valid held low so the registered address decode below sees the
+    // new owner's address before its transfer starts.  The CPU's look-ahead
+    // address is only valid for the cycle before it raises mem_valid, so a
+    // CPU access left waiting while the DMA engine had the bus is decoded
+    // from its held mem_addr instead.
+    wire cpu_mem_valid;
+    wire cpu_mem_ready;
+    wire [31:0] cpu_mem_addr;
+    wire [31:0] cpu_mem_wdata;
+    wire [3:0] cpu_mem_wstrb;
+    wire [31:0] cpu_mem_la_addr;
+    wire dma_m_req;
+    wire dma_m_valid;
+    wire dma_m_ready;
+    wire [31:0] dma_m_addr;
+    wire [31:0] dma_m_wdata;
+    wire [3:0] dma_m_wstrb;
+    reg bus_dma;
+    reg bus_settle;
+    
+    always @(posedge clk_rv) begin
+        if (!rst_rv) begin
+            bus_dma <= 1'b0;
+            bus_settle <= 1'b0;
+        end
+        else if (bus_settle) begin
+            if (!mem_ready)
+                bus_settle <= 1'b0;
+        end
+        else if (bus_dma) begin
+            // Alternate with the CPU a transfer at a time
+            if (!dma_m_req || (cpu_mem_valid && dma_m_valid && mem_ready)) begin
+                bus_dma <= 1'b0;
+                bus_settle <= 1'b1;
+            end
+        end
+        else if (dma_m_req && (!cpu_mem_valid || mem_ready)) begin
+            bus_dma <= 1'b1;
+            bus_settle <= 1'b1;
+        end
+    end
+    
+    assign mem_valid = !bus_settle && (bus_dma ? dma_m_valid : cpu_mem_valid);
+    assign mem_addr = bus_dma ? dma_m_addr : cpu_mem_addr;
+    assign mem_wdata = bus_dma ? dma_m_wdata : cpu_mem_wdata;
+    assign mem_wstrb = bus_dma ? dma_m_wstrb : cpu_mem_wstrb;
+    assign mem_la_addr = bus_dma ? dma_m_addr : (
+        cpu_mem_valid ? cpu_mem_addr : cpu_mem_la_addr);
+    assign cpu_mem_ready = !bus_settle && !bus_dma && mem_ready;
+    assign dma_m_ready = !bus_settle && bus_dma && mem_ready;
     
     wire la_addr_in_ram = (mem_la_addr >= 32'hFFFF0000);
     wire la_addr_in_vram = (mem_la_addr >= 32'h08000000) && (mem_la_addr < 32'h08004000);
     wire la_addr_in_gpio = (mem_la_addr >= 32'h03000000) && (mem_la_addr < 32'h03000100);
     wire la_addr_in_uart = (mem_la_addr == 32'h03000100);
     wire la_addr_in_z80_io = (mem_la_addr >= 32'h03000200) && (mem_la_addr < 32'h030002ff);
+    wire la_addr_in_dma = (mem_la_addr >= 32'h03000300) && (mem_la_addr < 32'h03000320);
     wire la_addr_in_usb = (mem_la_addr >= 32'h04000000) && (mem_la_addr < 32'h04080000);
     wire la_addr_in_z80 = (mem_la_addr >= 32'h05000000) && (mem_la_addr < 32'h05040000);
+    wire la_addr_in_z80w = (mem_la_addr >= 32'h05100000) && (mem_la_addr < 32'h05110000);
     wire la_addr_in_ddr = (mem_la_addr >= 32'h0C000000) && (mem_la_addr < 32'h0D000000);
     wire la_addr_in_spi = (mem_la_addr >= 32'h0E000000) && (mem_la_addr < 32'h0E020000);
     
@@ -579,7 +673,9 @@ module pano_top(
     reg addr_in_uart;
     reg addr_in_usb;
     reg addr_in_z80;
+    reg addr_in_z80w;
     reg addr_in_z80_io;
+    reg addr_in_dma;
     reg addr_in_ddr;
     reg addr_in_spi;
     
@@ -590,7 +686,9 @@ module pano_top(
         addr_in_uart <= la_addr_in_uart;
         addr_in_usb <= la_addr_in_usb;
         addr_in_z80 <= la_addr_in_z80;
+        addr_in_z80w <= la_addr_in_z80w;
         addr_in_z80_io <= la_addr_in_z80_io;
+        addr_in_dma <= la_addr_in_dma;
         addr_in_ddr <= la_addr_in_ddr;
         addr_in_spi <= la_addr_in_spi;
     end
@@ -602,7 +700,9 @@ module pano_top(
     assign ddr_valid = (mem_valid) && (addr_in_ddr);
     assign usb_valid = (mem_valid) && (addr_in_usb);
     assign z80_ram_valid = (mem_valid) && (addr_in_z80);
+    assign z80_ram32_valid = (mem_valid) && (addr_in_z80w);
     assign z80_io_valid = (mem_valid) && (addr_in_z80_io);
+    wire dma_reg_valid = (mem_valid) && (!mem_ready) && (addr_in_dma);
     assign spi_valid = (mem_valid) && (addr_in_spi);
     wire general_valid = (mem_valid) && (!mem_ready) && (!addr_in_ddr) && (!addr_in_uart) && (!addr_in_usb) && (!addr_in_spi);
     
@@ -618,7 +718,7 @@ module pano_top(
     reg mem_valid_last;
     always @(posedge clk_rv) begin
         mem_valid_last <= mem_valid;
-        if (mem_valid && !mem_valid_last && !(ram_valid || spi_valid || vram_valid || gpio_valid || usb_valid || uart_valid || ddr_valid || z80_ram_valid || z80_io_valid))
+        if (mem_valid && !mem_valid_last && !(ram_valid || spi_valid || vram_valid || gpio_valid || usb_valid || uart_valid || ddr_valid || z80_ram_valid || z80_ram32_valid || z80_io_valid || dma_reg_valid))
             cpu_irq <= 1'b1;
         //else
         //    cpu_irq <= 1'b0;
@@ -659,20 +759,45 @@ module pano_top(
         .ENABLE_IRQ_TIMER(0),
         .COMPRESSED_ISA(1),
         .PROGADDR_IRQ(PROGADDR_IRQ),
-        .MASKED_IRQ(32'hfffffffe),
-        .LATCHED_IRQ(32'hffffffff)
+        // irq 0: bus error, 3: DMA done, 4: USB, 5: Z80 I/O trap.  1 and 2
+        // are the PicoRV32's own ebreak and misaligned access interrupts.
+        // The DMA, USB and Z80 I/O interrupts are levels held until the
+        // source is serviced so they aren't latched.
+        .MASKED_IRQ(32'hffffffc6),
+        .LATCHED_IRQ(32'hffffffc7)
     ) cpu (
         .clk(clk_rv),
         .resetn(rst_rv),
-        .mem_valid(mem_valid),
+        .mem_valid(cpu_mem_valid),
         .mem_instr(mem_instr),
-        .mem_ready(mem_ready),
-        .mem_addr(mem_addr),
-        .mem_wdata(mem_wdata),
-        .mem_wstrb(mem_wstrb),
+        .mem_ready(cpu_mem_ready),
+        .mem_addr(cpu_mem_addr),
+        .mem_wdata(cpu_mem_wdata),
+        .mem_wstrb(cpu_mem_wstrb),
         .mem_rdata(mem_rdata),
-        .mem_la_addr(mem_la_addr),
-        .irq({31'b0, cpu_irq})
+        .mem_la_addr(cpu_mem_la_addr),
+        .irq({26'b0, z80_io_irq, usb_irq, dma_irq, 2'b0, cpu_irq})
+    );
+    
+    // DMA engine
+    wire [31:0] dma_rdata;
+    dma_engine dma_engine(
+        .clk(clk_rv),
+        .rst(!rst_rv),
+        .reg_valid(dma_reg_valid),
+        .reg_adr(mem_addr[4:2]),
+        .reg_wdata(mem_wdata),
+        .reg_wstr(mem_wstrb != 0),
+        .reg_rdata(dma_rdata),
+        .m_req(dma_m_req),
+        .m_valid(dma_m_valid),
+        .m_addr(dma_m_addr),
+        .m_wdata(dma_m_wdata),
+        .m_wstrb(dma_m_wstrb),
+        .m_rdata(mem_rdata),
+        .m_ready(dma_m_ready),
+        .bus_ready(mem_ready),
+        .irq(dma_irq)
     );
         
     // Internal RAM & Boot ROM
@@ -767,10 +892,12 @@ module pano_top(
         addr_in_ddr ? ddr_rdata_buf : (
         addr_in_gpio ? gpio_rdata : (
         addr_in_z80 ? {24'b0, z80ram_do_b} : (
+        addr_in_z80w ? z80ram_do_w : (
         addr_in_z80_io ? {8'b0, z80io_rdata} : (
+        addr_in_dma ? dma_rdata : (
         addr_in_usb ? usb_rdata : (
         addr_in_spi ? spi_rdata : (
-        32'hFFFFFFFF)))))));
+        32'hFFFFFFFF)))))))));
 
     // ----------------------------------------------------------------------
     // VGA Controller
@@ -847,10 +974,17 @@ module pano_top(
 
     // RISC V interface
         .io_valid(z80_io_valid),
-        .rv_wdata(mem_wdata[23:0]),
-        .rv_adr(mem_addr[5:2]),
+        .rv_wdata(mem_wdata),
+        .rv_adr(mem_addr[6:2]),
         .rv_wstr(mem_wstrb[0]),
         .rv_rdata(z80io_rdata),
+        .io_irq(z80_io_irq),
+
+     // Z80 memory interface
+        .dma_active(dma_active),
+        .dma_mem_wr(dma_mem_wr),
+        .dma_mem_adr(dma_mem_adr),
+        .dma_mem_data(dma_mem_data),
 
      // vga_mixer interface
         .font_fg_color(font_fg_color),
@@ -89,11 +89,26 @@ module pano_top_tb (
     wire z80_io_valid;
     wire [7:0] z80ram_do;
     wire [7:0] z80ram_do_b;
-    wire [7:0] z80io_rdata;
+    wire [23:0] z80io_rdata;
+    wire z80_io_irq;
     wire [3:0] mem_wstrb;
     wire [31:0] mem_addr;
     wire [31:0] mem_wdata;
 
+    // cpm_io copies sector cache hits into Z80 RAM through port A while the
+    // Z80 is held in wait
+    wire dma_active;
+    wire dma_mem_wr;
+    wire [15:0] dma_mem_adr;
+    wire [7:0] dma_mem_data;
+    // (dma_mem_wr outlasts dma_active by one clock for the last byte)
+    wire z80ram_dma = dma_active || dma_mem_wr;
+    wire z80ram_wea = z80ram_dma ? dma_mem_wr : z80_mem_wr;
+    wire [15:0] z80ram_addra = z80ram_dma ? dma_mem_adr : z80adr;
+    wire [7:0] z80ram_dina = z80ram_dma ? dma_mem_data : z80do;
+    wire [23:0] font_fg_color;
+    wire [23:0] font_bg_color;
+
     // RAMB16_S9_S9: Spartan-3/3E/3A/3AN/3AD 2k x 8 + 1 Parity bit Dual-Port RAM
     // Xilinx HDL Libraries Guide, version 11.2
     RAMB16_S9_S9 #(
@@ -111,11 +126,11 @@ module pano_top_tb (
     // .DOB(z80ram_do_b), // Port B 8-bit Data Output
     // .DOPA(DOPA), // Port A 1-bit Parity Output
     // .DOPB(DOPB), // Port B 1-bit Parity Output
-    .ADDRA(z80adr[10:0]), // Port A 11-bit Address Input
+    .ADDRA(z80ram_addra[10:0]), // Port A 11-bit Address Input
     .ADDRB(11'b0), // Port B 11-bit Address Input
     .CLKA(clk_4), // Port A Clock
     .CLKB(1'b0), // Port B Clock
-    .DIA(z80do), // Port A 8-bit Data Input
+    .DIA(z80ram_dina), // Port A 8-bit Data Input
     .DIB(8'b0), // Port B 8-bit Data Input
     .DIPA(1'b0), // Port A 1-bit parity Input
     .DIPB(1'b0), // Port-B 1-bit parity Input
@@ -123,7 +138,7 @@ module pano_top_tb (
     .ENB(1'b1), // Port B RAM Enable Input
     .SSRA(reset), // Port A Synchronous Set/Reset Input
     .SSRB(reset), // Port B Synchronous Set/Reset Input
-    .WEA(z80_mem_wr), // Port A Write Enable Input
+    .WEA(z80ram_wea), // Port A Write Enable Input
     .WEB(1'b0) // Port B Write Enable Input
     );
 
@@ -205,7 +220,7 @@ module pano_top_tb (
         .mem_wstrb(mem_wstrb),
         .mem_rdata(mem_rdata),
         .mem_la_addr(mem_la_addr),
-        .irq({31'b0, cpu_irq})
+        .irq({26'b0, z80_io_irq, 4'b0, cpu_irq})
     );
 
     // RAMB16_S36: Spartan-3/3E 512 x 32 + 4 Parity bits Single-Port RAM
@@ -237,7 +252,7 @@ module pano_top_tb (
 
     assign mem_rdata = 
         addr_in_ram ? ram_rdata : (
-        addr_in_z80_io ? {24'b0, z80io_rdata} : (
+        addr_in_z80_io ? {8'b0, z80io_rdata} : (
         32'hFFFFFFFF));
 
     cpm_io cpm_io(
@@ -254,10 +269,21 @@ module pano_top_tb (
 
     // RISC V interface
         .io_valid(z80_io_valid),
-        .rv_wdata(mem_wdata[7:0]),
-        .rv_adr(mem_addr[5:2]),
+        .rv_wdata(mem_wdata),
+        .rv_adr(mem_addr[6:2]),
         .rv_wstr(mem_wstrb[0]),
-        .rv_rdata(z80io_rdata)
+        .rv_rdata(z80io_rdata),
+        .io_irq(z80_io_irq),
+
+     // Z80 memory interface
+        .dma_active(dma_active),
+        .dma_mem_wr(dma_mem_wr),
+        .dma_mem_adr(dma_mem_adr),
+        .dma_mem_data(dma_mem_data),
+
+     // vga_mixer interface
+        .font_fg_color(font_fg_color),
+        .font_bg_color(font_bg_color)
     );
 
 endmodule
@@ -17,6 +17,16 @@
 // Revision 0.01 - File Created
 // Additional Comments: 
 //
+// sys_addr[18] == 0: 16 bit window, ISP address = sys_addr[18:1], one 16 bit
+//                    bus cycle per access, data in the low 16 bits.
+// sys_addr[18] == 1: 32 bit window, ISP address = sys_addr[15:0], two 16 bit
+//                    bus cycles (low half first) per access.
+//                    Reads from the ISP memory (address >= 0x400) prefetch
+//                    the following dword so sequential reads of the
+//                    auto-incrementing memory port overlap with the CPU.
+//                    Register reads are never prefetched since some
+//                    registers are cleared by reading.
+//
 //////////////////////////////////////////////////////////////////////////////////
 module usb_picorv_bridge(
     input wire clk,
@@ -35,14 +45,27 @@ module usb_picorv_bridge(
     input wire [15:0] usb_din,
     output reg bus_dir
     );
-    
+
     reg [2:0] state;
     reg [2:0] counter;
-    
+    reg wide;               // 32 bit access in progress
+    reg high_half;          // second 16 bit bus cycle of a 32 bit access
+    reg prefetch;           // current read is a prefetch
+    reg [15:0] rd_low;
+    reg [15:0] wr_high;
+    reg pf_pending;         // prefetch of pf_addr wanted
+    reg pf_valid;           // pf_data holds the data for pf_addr
+    reg [15:0] pf_addr;
+    reg [31:0] pf_data;
+
     localparam STATE_IDLE = 3'd0;
     localparam STATE_WRITE = 3'd1;
     localparam STATE_READ = 3'd2;
     localparam STATE_LATCH = 3'd3;
+    localparam STATE_GAP = 3'd4;
+
+    wire sys_wide = sys_addr[18];
+    wire pf_hit = sys_wide && pf_valid && (pf_addr == sys_addr[15:0]);
 
     always@(posedge clk) begin
         if (rst) begin
@@ -50,31 +73,64 @@ module usb_picorv_bridge(
             usb_csn <= 1'b1;
             bus_dir <= 1'b1;
             sys_ready <= 1'b0;
+            pf_pending <= 1'b0;
+            pf_valid <= 1'b0;
         end
         else begin
             case (state)
                 STATE_IDLE: begin
+                    high_half <= 1'b0;
                     if (sys_valid) begin
                         if (sys_wstrb != 0) begin
+                            // Writes may move the ISP memory pointer
+                            pf_pending <= 1'b0;
+                            pf_valid <= 1'b0;
+                            wide <= sys_wide;
+                            prefetch <= 1'b0;
+                            wr_high <= sys_wdata[31:16];
                             usb_csn <= 1'b0;
                             usb_rdn <= 1'b1;
                             usb_wrn <= 1'b0;
                             usb_dout <= sys_wdata[15:0];
-                            usb_a[17:1] <= sys_addr[18:2];
+                            usb_a[17:1] <= sys_wide ? sys_addr[15:1] : sys_addr[18:2];
                             bus_dir <= 1'b0;
                             sys_ready <= 1'b1;
                             state <= STATE_WRITE;
                             counter <= 3'd4;
                         end
+                        else if (pf_hit) begin
+                            sys_rdata <= pf_data;
+                            sys_ready <= 1'b1;
+                            pf_valid <= 1'b0;
+                            pf_pending <= 1'b1;
+                            pf_addr <= pf_addr + 16'd4;
+                            state <= STATE_LATCH;
+                        end
                         else begin
+                            pf_pending <= 1'b0;
+                            pf_valid <= 1'b0;
+                            wide <= sys_wide;
+                            prefetch <= 1'b0;
                             usb_csn <= 1'b0;
                             usb_rdn <= 1'b0;
                             usb_wrn <= 1'b1;
-                            usb_a[17:1] <= sys_addr[18:2];
+                            usb_a[17:1] <= sys_wide ? sys_addr[15:1] : sys_addr[18:2];
                             state <= STATE_READ;
                             counter <= 3'd4;
                         end
                     end
+                    else if (pf_pending) begin
+                        // Nothing to do, read ahead
+                        pf_pending <= 1'b0;
+                        wide <= 1'b1;
+                        prefetch <= 1'b1;
+                        usb_csn <= 1'b0;
+                        usb_rdn <= 1'b0;
+                        usb_wrn <= 1'b1;
+                        usb_a[17:1] <= pf_addr[15:1];
+                        state <= STATE_READ;
+                        counter <= 3'd4;
+                    end
                     else begin
                         usb_csn <= 1'b1;
                         usb_rdn <= 1'b1;
@@ -90,20 +146,62 @@ module usb_picorv_bridge(
                     end
                     else if (counter == 0) begin
                         usb_csn <= 1'b1;
-                        bus_dir <= 1'b1;
-                        state <= STATE_IDLE;
+                        if (wide && !high_half) begin
+                            state <= STATE_GAP;
+                            counter <= 3'd1;
+                        end
+                        else begin
+                            bus_dir <= 1'b1;
+                            state <= STATE_IDLE;
+                        end
                     end
                 end
                 STATE_READ: begin
                     sys_ready <= 1'b0;
                     counter <= counter - 1;
                     if (counter == 0) begin
-                        sys_rdata <= {16'd0, usb_din};
-                        sys_ready <= 1'b1;
                         usb_csn <= 1'b1;
                         usb_rdn <= 1'b1;
                         usb_wrn <= 1'b1;
-                        state <= STATE_LATCH;
+                        if (wide && !high_half) begin
+                            rd_low <= usb_din;
+                            state <= STATE_GAP;
+                            counter <= 3'd1;
+                        end
+                        else if (prefetch) begin
+                            pf_data <= {usb_din, rd_low};
+                            pf_valid <= 1'b1;
+                            state <= STATE_IDLE;
+                        end
+                        else begin
+                            sys_rdata <= wide ? {usb_din, rd_low} : {16'd0, usb_din};
+                            sys_ready <= 1'b1;
+                            if (wide && usb_a[15:10] != 6'd0) begin
+                                // ISP memory read, fetch the next dword
+                                pf_pending <= 1'b1;
+                                pf_addr <= {usb_a[15:2], 2'b00} + 16'd4;
+                            end
+                            state <= STATE_LATCH;
+                        end
+                    end
+                end
+                STATE_GAP: begin
+                    // Second half of a 32 bit access
+                    counter <= counter - 1;
+                    if (counter == 0) begin
+                        high_half <= 1'b1;
+                        usb_a <= usb_a + 1'b1;
+                        usb_csn <= 1'b0;
+                        counter <= 3'd4;
+                        if (bus_dir == 1'b0) begin
+                            usb_wrn <= 1'b0;
+                            usb_dout <= wr_high;
+                            state <= STATE_WRITE;
+                        end
+                        else begin
+                            usb_rdn <= 1'b0;
+                            state <= STATE_READ;
+                        end
                     end
                 end
                 STATE_LATCH: begin
@@ -112,7 +210,7 @@ module usb_picorv_bridge(
                 end
             endcase
         end
-    
+
     end
 
 
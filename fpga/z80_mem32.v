@@ -0,0 +1,85 @@
+`timescale 1ns / 1ps
+
+// Z80 64K RAM with a 32 bit RISC V port
+// Copyright (C) 2019  Skip Hansen
+
+//  This program is free software; you can redistribute it and/or modify it
+//  under the terms and conditions of the GNU General Public License,
+//  version 2, as published by the Free Software Foundation.
+//
+//  This program is distributed in the hope it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+//  more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with this program; if not, write to the Free Software Foundation, Inc.,
+//  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+
+// The Spartan 3E block RAMs don't have byte write enables so the 64K is
+// built from 4 byte lanes of 16K each.  Z80 address bits [1:0] select
+// the lane, bits [15:2] the word within the lane.
+//
+// Port A: Z80, 8 bits wide.
+// Port B: RISC V, 32 bits wide with byte write strobes.  RISC V word n
+// holds Z80 bytes 4n (bits 7:0) through 4n+3 (bits 31:24), i.e. the same
+// little endian layout as a memcpy of the Z80 memory.
+
+module z80_mem32 (
+    // Z80 interface
+    input clka,
+    input wea,
+    input [15:0] addra,
+    input [7:0] dina,
+    output [7:0] douta,
+    // RISC V interface
+    input clkb,
+    input [3:0] web,
+    input [13:0] addrb,
+    input [31:0] dinb,
+    output reg [31:0] doutb
+);
+
+    reg [7:0] mem_0 [0:16383];
+    reg [7:0] mem_1 [0:16383];
+    reg [7:0] mem_2 [0:16383];
+    reg [7:0] mem_3 [0:16383];
+
+    wire [13:0] word_a = addra[15:2];
+    reg [1:0] lane_a;
+    reg [7:0] douta_0;
+    reg [7:0] douta_1;
+    reg [7:0] douta_2;
+    reg [7:0] douta_3;
+
+    // Port A
+    always @(posedge clka) begin
+        lane_a <= addra[1:0];
+        if (wea && addra[1:0] == 2'd0) mem_0[word_a] <= dina;
+        if (wea && addra[1:0] == 2'd1) mem_1[word_a] <= dina;
+        if (wea && addra[1:0] == 2'd2) mem_2[word_a] <= dina;
+        if (wea && addra[1:0] == 2'd3) mem_3[word_a] <= dina;
+        douta_0 <= mem_0[word_a];
+        douta_1 <= mem_1[word_a];
+        douta_2 <= mem_2[word_a];
+        douta_3 <= mem_3[word_a];
+    end
+
+    assign douta =
+        lane_a == 2'd0 ? douta_0 : (
+        lane_a == 2'd1 ? douta_1 : (
+        lane_a == 2'd2 ? douta_2 : douta_3));
+
+    // Port B
+    always @(posedge clkb) begin
+        if (web[0]) mem_0[addrb] <= dinb[ 7: 0];
+        if (web[1]) mem_1[addrb] <= dinb[15: 8];
+        if (web[2]) mem_2[addrb] <= dinb[23:16];
+        if (web[3]) mem_3[addrb] <= dinb[31:24];
+        doutb[ 7: 0] <= mem_0[addrb];
+        doutb[15: 8] <= mem_1[addrb];
+        doutb[23:16] <= mem_2[addrb];
+        doutb[31:24] <= mem_3[addrb];
+    end
+
+endmodule
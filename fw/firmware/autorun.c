@@ -0,0 +1,271 @@
+/*
+ *  autorun.c
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Console input from a file for unattended runs.
+ *
+ * If AUTORUN.TXT is present in the root directory it's typed into the 
+ * keyboard queue a line at a time.  A line is only started when the 
+ * hardware reports that the Z80 is waiting for console input and nothing
+ * typed on the keyboard is queued.  Programs that check the console for
+ * a key press to abort what they are doing therefore don't see the next 
+ * line early.
+ *
+ * Line feeds are sent as carriage returns, CR LF pairs as a single 
+ * carriage return.
+ *
+ * While AUTORUN.TXT is in use all console output is also written to 
+ * CONSOLE.LOG.  The output is collected in LPDDR and written a cluster at 
+ * a time.  When the output stops the partial cluster at the end is written 
+ * and synced, but it's kept in the buffer and rewritten with the following
+ * output so every write starts on a cluster boundary.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "string.h"
+
+#include "ff.h"
+#include "usb.h"
+#include "cpm_io.h"
+#include "misc.h"
+#include "ddr_mem.h"
+#include "autorun.h"
+
+// #define DEBUG_LOGGING
+// #define LOG_TO_BOTH
+// #define VERBOSE_DEBUG_LOGGING
+#include "log.h"
+
+static FIL gAutorunFile;
+static bool gAutorunActive;
+static bool gLineStarted;  // part of the current line has been queued
+static bool gLastCr;       // last character read was a carriage return
+static int gPending = -1;  // character read but not queued yet
+static uint8_t gBuf[FF_MIN_SS];
+static UINT gBufLen;
+static UINT gBufPos;
+
+static FIL gLogFile;
+static uint8_t *gLogMem;   // LPDDR for the buffer, allocated once
+static uint8_t *gLogBuf;   // NULL when output isn't being captured
+static uint32_t gLogLen;   // bytes in gLogBuf
+static uint32_t gLogChunk; // cluster size, at most CONSOLE_LOG_BUF_SIZE
+static FSIZE_t gLogPos;    // file position of gLogBuf[0], cluster aligned
+static uint32_t gLogLast;  // ticks_ms() of the last output
+static bool gLogDirty;     // gLogBuf has data that hasn't been synced
+
+static void LogOpen()
+{
+   FRESULT Err;
+
+   do {
+      if(gLogMem == NULL && 
+         (gLogMem = DdrAlloc(CONSOLE_LOG_BUF_SIZE)) == NULL)
+      {
+         break;
+      }
+      gLogBuf = gLogMem;
+      Err = f_open(&gLogFile,CONSOLE_LOG_FILENAME,FA_WRITE | FA_CREATE_ALWAYS);
+      if(Err != FR_OK) {
+         ELOG("Couldn't create %s, %d\n",CONSOLE_LOG_FILENAME,Err);
+         gLogBuf = NULL;
+         break;
+      }
+      gLogChunk = gLogFile.obj.fs->csize * FF_MIN_SS;
+      if(gLogChunk > CONSOLE_LOG_BUF_SIZE) {
+         gLogChunk = CONSOLE_LOG_BUF_SIZE;
+      }
+      gLogLen = 0;
+      gLogPos = 0;
+      gLogDirty = false;
+      LOG("Console output to %s\n",CONSOLE_LOG_FILENAME);
+   } while(false);
+}
+
+// Write the whole clusters in the buffer, and the partial cluster at the
+// end too if bAll is set
+static void LogWrite(bool bAll)
+{
+   uint32_t Len = gLogLen / gLogChunk * gLogChunk;
+   uint32_t WriteLen = bAll ? gLogLen : Len;
+   UINT Wrote = 0;
+   FRESULT Err;
+
+   do {
+      if(WriteLen == 0) {
+         break;
+      }
+      if((Err = f_lseek(&gLogFile,gLogPos)) != FR_OK ||
+         (Err = f_write(&gLogFile,gLogBuf,WriteLen,&Wrote)) != FR_OK ||
+         Wrote != WriteLen ||
+         (bAll && (Err = f_sync(&gLogFile)) != FR_OK))
+      {
+         ELOG("Writing %s failed: %d\n",CONSOLE_LOG_FILENAME,Err);
+         f_close(&gLogFile);
+         gLogBuf = NULL;
+         break;
+      }
+      if(bAll) {
+         gLogDirty = false;
+      }
+      if(Len > 0) {
+      // The remainder is shorter than a cluster so it can't overlap
+         gLogPos += Len;
+         gLogLen -= Len;
+         memcpy(gLogBuf,gLogBuf + Len,gLogLen);
+      }
+   } while(false);
+}
+
+// Allocate the CONSOLE.LOG buffer if AUTORUN.TXT is present.  Called 
+// before the drives are mounted so images loaded into LPDDR can't use up
+// the space for it.
+void AutorunReserve()
+{
+   FILINFO Info;
+
+   if(gLogMem == NULL && f_stat(AUTORUN_FILENAME,&Info) == FR_OK) {
+      gLogMem = DdrAlloc(CONSOLE_LOG_BUF_SIZE);
+   }
+}
+
+void AutorunOpen()
+{
+   if(f_open(&gAutorunFile,AUTORUN_FILENAME,FA_READ) == FR_OK) {
+      LOG("Console input from %s\n",AUTORUN_FILENAME);
+      gAutorunActive = true;
+      gLineStarted = false;
+      gLastCr = false;
+      gPending = -1;
+      gBufLen = gBufPos = 0;
+      LogOpen();
+   }
+}
+
+// Return the next character from the file or -1 at the end
+static int AutorunGetc()
+{
+   FRESULT Err;
+
+   if(gBufPos == gBufLen) {
+      gBufPos = 0;
+      if((Err = f_read(&gAutorunFile,gBuf,sizeof(gBuf),&gBufLen)) != FR_OK) {
+         ELOG("f_read failed: %d\n",Err);
+         gBufLen = 0;
+      }
+      if(gBufLen == 0) {
+         return -1;
+      }
+   }
+   return gBuf[gBufPos++];
+}
+
+void AutorunPoll()
+{
+   int c;
+
+   do {
+      if(!gAutorunActive) {
+         break;
+      }
+      if(!gLineStarted) {
+         if(!(z80_con_in_count & CON_IN_WANTED) || usb_kbd_testc()) {
+            break;
+         }
+         gLineStarted = true;
+      }
+
+      for( ; ; ) {
+         if(gPending < 0) {
+            if((c = AutorunGetc()) < 0) {
+               LOG("%s done\n",AUTORUN_FILENAME);
+               f_close(&gAutorunFile);
+               gAutorunActive = false;
+               break;
+            }
+            if(c == '\n') {
+               if(gLastCr) {
+                  gLastCr = false;
+                  continue;
+               }
+               c = '\r';
+            }
+            else {
+               gLastCr = c == '\r';
+            }
+            gPending = c;
+         }
+         if(!usb_kbd_putc((char) gPending)) {
+         // Make room by moving the queue to the console input FIFO
+            ConsoleInPoll();
+            if(!usb_kbd_putc((char) gPending)) {
+               break;
+            }
+         }
+         c = gPending;
+         gPending = -1;
+         if(c == '\r') {
+            gLineStarted = false;
+            break;
+         }
+      }
+   } while(false);
+}
+
+// Called with console output from the Z80
+void AutorunLog(const uint8_t *pData,uint32_t Len)
+{
+   uint32_t Copy;
+
+   while(gLogBuf != NULL && Len > 0) {
+      if(gLogLen == CONSOLE_LOG_BUF_SIZE) {
+         LogWrite(false);
+         continue;
+      }
+      Copy = CONSOLE_LOG_BUF_SIZE - gLogLen;
+      if(Copy > Len) {
+         Copy = Len;
+      }
+      memcpy(gLogBuf + gLogLen,pData,Copy);
+      gLogLen += Copy;
+      pData += Copy;
+      Len -= Copy;
+      gLogLast = ticks_ms();
+      gLogDirty = true;
+   }
+}
+
+void AutorunLogPoll()
+{
+   if(gLogBuf != NULL) {
+      if(gLogLen >= gLogChunk) {
+         LogWrite(false);
+      }
+      else if(gLogDirty && ticks_ms() - gLogLast >= CONSOLE_LOG_DELAY) {
+         LogWrite(true);
+      }
+   }
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 3
+ * End:
+ */
@@ -0,0 +1,36 @@
+/*
+ *  autorun.h
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#ifndef _AUTORUN_H_
+#define _AUTORUN_H_
+
+#include <stdint.h>
+
+#define AUTORUN_FILENAME      "AUTORUN.TXT"
+#define CONSOLE_LOG_FILENAME  "CONSOLE.LOG"
+#define CONSOLE_LOG_BUF_SIZE  0x10000     // 64K in LPDDR
+#define CONSOLE_LOG_DELAY     2000        // ms after the last output
+
+void AutorunReserve(void);
+void AutorunOpen(void);
+void AutorunPoll(void);
+void AutorunLog(const uint8_t *pData,uint32_t Len);
+void AutorunLogPoll(void);
+
+#endif   // _AUTORUN_H_
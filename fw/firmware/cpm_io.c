@@ -41,14 +41,24 @@
 #include "vt100.h"
 #include "misc.h"
 #include "rtc.h"
+#include "disk_cache.h"
+#include "disk_image.h"
+#include "sparse_map.h"
+#include "dma.h"
+#include "ddr_mem.h"
+#include "autorun.h"
 
 // #define DEBUG_LOGGING
 // #define LOG_TO_BOTH
 // #define VERBOSE_DEBUG_LOGGING
 #include "log.h"
 
-#define CPM_SECTOR_SIZE       128
 #define WRITE_FLUSH_TO        500      // .5 seconds
+#define WRITE_FLUSH_MAX       2000     // 2 seconds
+#define FLUSH_SLICE_BLOCKS    8        // 4K per flash write between Z80 I/O
+// Load floppy and 4 MB hard disk images into LPDDR when they are mounted,
+// comment out to always use the track cache
+#define RESIDENT_IMAGE_MAX    4177920
 #define MULTICOMP_DRIVE_SIZE  (1024*1024*8)  // 8mb
 
 const struct {
@@ -56,11 +66,12 @@ const struct {
    uint32_t FileSize;
    uint16_t Tracks;
    uint16_t Sectors;
+   uint16_t SysTracks;  // reserved tracks holding CP/M when booted from
 } FormatLookup[] = {
-   { "8 inch SSSD floppy", 256256, 77, 26 },
-   { "4 MB z80pack hard disk", 4177920, 255, 128 },
-   { "8 MB Multicomp hard disk", 8388608, 256, 128 },
-   { "512 MB hard disk", 536870912, 256, 16384 },
+   { "8 inch SSSD floppy", 256256, 77, 26, 2 },
+   { "4 MB z80pack hard disk", 4177920, 255, 128, 0 },
+   { "8 MB Multicomp hard disk", 8388608, 256, 128, 1 },
+   { "512 MB hard disk", 536870912, 256, 16384, 0 },
    {NULL}   // end of table
 };
 
@@ -87,17 +98,42 @@ const char *DiskTypeDesc[] = {
 struct dskdef {
    unsigned int tracks;
    unsigned int sectors;
-   bool bFlushWriteCache;
    bool bMultiCompDrive;
    FIL *fp;           // file object strcture
+   uint8_t *pRam;     // RAM drive data in LPDDR, NULL for image files
    DiskType Type;
+   bool bDirty;         // unflushed writes in the write back cache
+   uint32_t DirtySince; // ticks() of first unflushed write
+   uint32_t LastWrite;  // ticks() of last write
 };
 
 FIL FpArray[MAX_MOUNTED_DRIVES+1];
 #define BOOT_FILE_INDEX       MAX_MOUNTED_DRIVES
 
 int gMountedDrives;
-uint32_t gWriteFlushTimeout;
+// Image being flushed incrementally by FlushPoll and when the flush started
+static FIL *gFlushFp;
+static uint32_t gFlushStart;
+// Copy of the Z80 RAM loaded at reset, later resets are restored from here
+#define BOOT_COPY_SIZE        0x10000
+static uint8_t *gBootCopy;
+static uint32_t gBootCopyLen;
+static bool gBootCopyIsSector;   // copy is the system drive's boot sector
+#define LOAD_CHUNK_MAX        0x2000   // largest read while loading BOOT.IMG
+// Optional BOOT.IMG header, images without one are loaded at and started 
+// from 0
+typedef struct {
+   uint32_t Magic;      // BOOT_HDR_MAGIC
+   uint16_t LoadAdr;
+   uint16_t StartAdr;
+   uint32_t Reserved[2];
+} BootHeader;
+// Copy of drive A's system tracks for FDC_READ_SYSTEM, invalid if
+// gSysSnapLen is 0
+static uint8_t *gSysSnap;
+static uint32_t gSysSnapLen;
+static uint16_t gSysSnapTracks;
+static uint32_t gSysSnapSum;
 FIL *gSystemFp;
 MapMode gMountMode;
 unsigned char gZ80_ResetRequest;
@@ -111,30 +147,115 @@ static BYTE clkcmd;		/* clock command */
 static BYTE clkfmt = 0;		/* clock format, 0 = BCD, 1 = decimal */
 
 static void fdco_out(uint8_t Data);
-void CopyToZ80(uint8_t *pTo,uint8_t *pFrom,int Len);
-void CopyFromZ80(uint8_t *pTo,uint8_t *pFrom,int Len);
+void CopyToZ80(uint16_t Adr,const uint8_t *pFrom,int Len);
+void CopyFromZ80(uint8_t *pTo,uint16_t Adr,int Len);
 MapMode MountBootDrive(void);
 void ListMountedDrives(DiskType Type);
 
-void CopyToZ80(uint8_t *pTo,uint8_t *pFrom,int Len)
+// Copy to/from Z80 memory through the packed window, a word at a time
+// where possible.  Byte loads and stores work in the packed window too
+// so unaligned heads and tails are simply copied a byte at a time.
+void CopyToZ80(uint16_t Adr,const uint8_t *pFrom,int Len)
 {
-   VLOG("Copying %d bytes from 0x%x to 0x%x\n",Len,(unsigned int) pFrom,
-       (unsigned int) pTo);
+   volatile uint8_t *pTo = (volatile uint8_t *) (Z80_MEMORY32_ADR + Adr);
+   volatile uint32_t *pTo32;
+   const uint32_t *pFrom32;
+   uint32_t Word;
+
+   VLOG("Copying %d bytes from 0x%x to Z80 0x%x\n",Len,(unsigned int) pFrom,
+       Adr);
+
+   while(Len > 0 && ((uint32_t) pTo & 3) != 0) {
+      *pTo++ = *pFrom++;
+      Len--;
+   }
+
+   pTo32 = (volatile uint32_t *) pTo;
+   if(((uint32_t) pFrom & 3) == 0) {
+      pFrom32 = (const uint32_t *) pFrom;
+      if(DmaCopy((void *) pTo32,pFrom32,Len & ~3)) {
+         pTo32 += Len >> 2;
+         pFrom32 += Len >> 2;
+         Len &= 3;
+      }
+      while(Len >= 4) {
+         *pTo32++ = *pFrom32++;
+         Len -= 4;
+      }
+      pFrom = (const uint8_t *) pFrom32;
+   }
+   else {
+      while(Len >= 4) {
+         Word = pFrom[0] | (pFrom[1] << 8) | (pFrom[2] << 16) | (pFrom[3] << 24);
+         *pTo32++ = Word;
+         pFrom += 4;
+         Len -= 4;
+      }
+   }
+   pTo = (volatile uint8_t *) pTo32;
 
-   while(Len -- > 0) {
-      *pTo = *pFrom++;
-      pTo += 4;
+   while(Len-- > 0) {
+      *pTo++ = *pFrom++;
    }
 }
 
-void CopyFromZ80(uint8_t *pTo,uint8_t *pFrom,int Len)
+void CopyFromZ80(uint8_t *pTo,uint16_t Adr,int Len)
 {
-   VLOG("Copying %d bytes from 0x%x to 0x%x\n",Len,(unsigned int) pFrom,
+   volatile uint8_t *pFrom = (volatile uint8_t *) (Z80_MEMORY32_ADR + Adr);
+   volatile uint32_t *pFrom32;
+   uint32_t *pTo32;
+   uint32_t Word;
+
+   VLOG("Copying %d bytes from Z80 0x%x to 0x%x\n",Len,Adr,
        (unsigned int) pTo);
 
-   while(Len -- > 0) {
-      *pTo++ = *pFrom;
-      pFrom += 4;
+   while(Len > 0 && ((uint32_t) pFrom & 3) != 0) {
+      *pTo++ = *pFrom++;
+      Len--;
+   }
+
+   pFrom32 = (volatile uint32_t *) pFrom;
+   if(((uint32_t) pTo & 3) == 0) {
+      pTo32 = (uint32_t *) pTo;
+      if(DmaCopy(pTo32,(void *) pFrom32,Len & ~3)) {
+         pTo32 += Len >> 2;
+         pFrom32 += Len >> 2;
+         Len &= 3;
+      }
+      while(Len >= 4) {
+         *pTo32++ = *pFrom32++;
+         Len -= 4;
+      }
+      pTo = (uint8_t *) pTo32;
+   }
+   else {
+      while(Len >= 4) {
+         Word = *pFrom32++;
+         *pTo++ = (uint8_t) Word;
+         *pTo++ = (uint8_t) (Word >> 8);
+         *pTo++ = (uint8_t) (Word >> 16);
+         *pTo++ = (uint8_t) (Word >> 24);
+         Len -= 4;
+      }
+   }
+   pFrom = (volatile uint8_t *) pFrom32;
+
+   while(Len-- > 0) {
+      *pTo++ = *pFrom++;
+   }
+}
+
+// Load a sector into the FPGA's sector cache so future reads of it are
+// completed in hardware
+static void SectorCacheFill(uint8_t Drive,uint8_t Track,uint16_t Sector,
+                            const uint8_t *pData)
+{
+   int i;
+
+   z80_sc_tag = (Drive << 24) | (Track << 16) | Sector;
+   for(i = 0; i < CPM_SECTOR_SIZE; i += 4) {
+      z80_sc_data = pData[i] | (pData[i+1] << 8) | (pData[i+2] << 16) |
+                    (pData[i+3] << 24);
    }
 }
 
@@ -269,29 +390,9 @@ static void clkd_out(BYTE data)
 // This routine is called when the Z80 performs an IO read operation
 void HandleIoIn(uint8_t IoPort)
 {
-   uint8_t Ret;
    int Data = -1;
 
    switch(IoPort) {
-      case 1:  // console data
-         if(!usb_kbd_testc()) {
-            VLOG("Waiting for console input, z80_con_status: 0x%x\n",
-                z80_con_status);
-            while(!usb_kbd_testc() && !gZ80_ResetRequest) {
-               IdlePoll();
-            }
-            VLOG("Continuing\n");
-         }
-         if(!gZ80_ResetRequest) {
-            Data = (uint8_t) (usb_kbd_getc() & 0x7f);
-            if(!usb_kbd_testc()) {
-               z80_con_status = 0;
-               VLOG("No more data available, z80_con_status: 0x%x\n",
-                    z80_con_status);
-            }
-         }
-         break;
-
       case 14: // FDC status
          Data = gDiskStatus;
          break;
@@ -317,6 +418,7 @@ void HandleIoIn(uint8_t IoPort)
          
 // The following are implemented in hardware so we should never see them here
       case 0:  // console status
+      case 1:  // console data
       case 10: // FDC drive
       case 11: // FDC track
       case 12: // FDC sector (low)
@@ -373,20 +475,44 @@ void HandleIoIn(uint8_t IoPort)
    }
 }
 
+// Copy the console output queued by the hardware to the screen
+void ConsoleOutPoll()
+{
+   uint8_t Buf[CON_OUT_FIFO_SIZE];
+   uint32_t Count = z80_con_out_count;
+   uint32_t i;
+
+   if(Count > 0) {
+      for(i = 0; i < Count; i++) {
+         Buf[i] = (uint8_t) z80_con_out_data;
+      }
+      vt100_write(Buf,Count);
+      AutorunLog(Buf,Count);
+   }
+}
+
+// Queue keyboard input in the hardware console input FIFO, the console 
+// status and input ports are then answered without the RISC V
+void ConsoleInPoll()
+{
+   while(usb_kbd_testc() && 
+         (z80_con_in_count & CON_IN_COUNT_MASK) < CON_IN_FIFO_SIZE)
+   {
+      z80_con_in_data = usb_kbd_getc() & 0x7f;
+   }
+}
+
 // This routine is called when the Z80 performs an IO write operation
 void HandleIoOut(uint8_t IoPort,uint8_t Data)
 {
    switch(IoPort) {
-      case 1:  // console data
-         vt100_putc(Data);
-         break;
-
       case 13: // FDC command
          VLOG("0x%x -> %d\n",Data,IoPort);
          fdco_out(Data);
          break;
 
 // The following are implemented in hardware so we should never see them here
+      case 1:  // console data
       case 10: // FDC drive
       case 11: // FDC track
       case 12: // FDC sector (low)
@@ -394,6 +520,7 @@ void HandleIoOut(uint8_t IoPort,uint8_t Data)
       case 15: // DMA destination address low
       case 16: // DMA destination address high
       case 17: // FDC sector high
+      case 18: // FDC sector count
          ELOG("Unexpected output of 0x%x to port 0x%x\n",Data,IoPort);
          break;
 
@@ -447,61 +574,50 @@ void HandleIoOut(uint8_t IoPort,uint8_t Data)
    }
 }
 
-/*
- * I/O handler for write FDC command:
- * transfer one sector in the wanted direction,
- * 0 = read, 1 = write
- *
- * The status byte of the FDC is set as follows:
- *   0 - ok
- *   1 - illegal drive
- *   2 - illegal track
- *   3 - illegal sector
- *   4 - seek error
- *   5 - read error
- *   6 - write error
- *   7 - illegal command to FDC
- */
-static void fdco_out(uint8_t Data)
+// Read or write a single sector, returns the FDC status
+static uint8_t FdcSector(bool bWrite,uint8_t Drive,uint16_t Track,
+                         uint16_t Sector,uint16_t DmaAdr,bool bFillSc)
 {
    register int i;
    unsigned long pos;
+   unsigned long TrackPos;
+   uint32_t LineSectors;
    uint8_t status = 0;  // Assume the best
    FIL *fp = NULL;
-   FRESULT Err;
-   UINT Wrote;
-   UINT Read;
+   uint32_t Now;
+   uint8_t *pData;
    uint8_t Buf[CPM_SECTOR_SIZE];
-   uint8_t Drive = z80_drive;
-   uint8_t Track = z80_track;
-   uint16_t Sector = (z80_sector_msb << 8) + z80_sector_lsb;
-   uint16_t DmaAdr = (z80_dma_msb << 8) + z80_dma_lsb;
-   void *pBuf = (void *) ((DmaAdr << 2) + Z80_MEMORY_ADR);
    struct dskdef *pDisk = &gDisks[Drive];
+   int StatsDrive = Drive;
 
    do {
-      if(Data > 1) {
-         ELOG("Invalid command %d\n",Data);
-         status = 7;
-         break;
-      }
-      VLOG("Disk %s %d:%d:%d @ 0x%x\n",Data == 0 ? "read" : "write",
+      VLOG("Disk %s %d:%d:%d @ 0x%x\n",bWrite ? "write" : "read",
            Drive,Track,Sector,DmaAdr);
-      if(Drive >= MAX_LOGICAL_DRIVES || (fp = pDisk->fp) == NULL) {
+      if(Drive >= MAX_LOGICAL_DRIVES || 
+         ((fp = pDisk->fp) == NULL && pDisk->pRam == NULL))
+      {
          ELOG("Invalid drive %d\n",Drive);
          status = 1;
          break;
       }
-      if(Track > pDisk->tracks) {
+      if(Track >= pDisk->tracks) {
          ELOG("Invalid track %d\n",Track);
          status = 2;
          break;
       }
-      if(Sector > pDisk->sectors) {
+      if(Sector == 0 || Sector > pDisk->sectors) {
          ELOG("Invalid sector %d\n",Sector);
          status = 3;
          break;
       }
+   // The track cache reads whole tracks, or CACHE_LINE_SECTORS sized
+   // segments of tracks for the 512 MB format
+      i = (Sector - 1) / CACHE_LINE_SECTORS * CACHE_LINE_SECTORS;
+      LineSectors = pDisk->sectors - i;
+      if(LineSectors > CACHE_LINE_SECTORS) {
+         LineSectors = CACHE_LINE_SECTORS;
+      }
+      TrackPos = (((long)Track) * ((long)pDisk->sectors) + i) << 7;
       pos = (((long)Track) * ((long)pDisk->sectors) + Sector - 1) << 7;
 
       if(pDisk->bMultiCompDrive) {
@@ -512,65 +628,284 @@ static void fdco_out(uint8_t Data)
          else if(Drive > 0) {
          // Add offset in SD card image for this drive
             pos += MULTICOMP_DRIVE_SIZE * Drive;
+            TrackPos += MULTICOMP_DRIVE_SIZE * Drive;
          }
          Drive = 0;
          pDisk = gDisks;
       }
-      if((Err = f_lseek(fp,pos)) != FR_OK) {
-         ELOG("f_lseek failed: %d\n",Err);
-         status = 4;
-         break;
+
+      if(bWrite && StatsDrive == 0 && Track < gSysSnapTracks) {
+      // System tracks rewritten (SYSGEN), take a new snapshot when needed
+         gSysSnapLen = 0;
       }
 
-      switch(Data) {
-         case 0:  /* read */
-            leds = LED_GREEN;
-            if((Err = f_read(fp,&Buf,CPM_SECTOR_SIZE,&Read)) != FR_OK) {
-               ELOG("f_read failed: %d\n",Err);
-               status = 5;
+      leds = LED_GREEN;
+      if(!bWrite) {
+         if(pDisk->pRam != NULL) {
+            pData = pDisk->pRam + pos;
+         }
+         else {
+            pData = CacheRead(StatsDrive,fp,TrackPos,
+                              LineSectors * CPM_SECTOR_SIZE,pos - TrackPos);
+         }
+         if(pData == NULL) {
+            status = 5;
+         }
+         else {
+         // Load the sector cache while the DMA engine copies the sector to
+         // Z80 RAM
+            if(!DmaCopyStart((void *) (Z80_MEMORY32_ADR + DmaAdr),pData,
+                             CPM_SECTOR_SIZE))
+            {
+               CopyToZ80(DmaAdr,pData,CPM_SECTOR_SIZE);
             }
-            else if(Read != CPM_SECTOR_SIZE) {
-               ELOG("Short read failure, read %d, requested %d\n",Read,
-                    CPM_SECTOR_SIZE);
-               status = 5;
+            if(bFillSc) {
+               SectorCacheFill(StatsDrive,Track,Sector,pData);
             }
-            else {
-               CopyToZ80(pBuf,Buf,CPM_SECTOR_SIZE);
+            DmaWait();
+         }
+      }
+      else if(pDisk->pRam != NULL) {
+         CopyFromZ80(pDisk->pRam + pos,DmaAdr,CPM_SECTOR_SIZE);
+      }
+      else {
+         CopyFromZ80(Buf,DmaAdr,CPM_SECTOR_SIZE);
+         if(gBootCopyIsSector && pos < CPM_SECTOR_SIZE &&
+            fp == (gMountMode == MAP_Z80PACK ? gDisks[0].fp : gSystemFp))
+         {
+         // Boot sector rewritten (SYSGEN), reload it on the next reset
+            gBootCopyLen = 0;
+         }
+         if(CacheWrite(StatsDrive,fp,pos,Buf) != 0) {
+            status = 6;
+         }
+         else {
+         // FlushPoll writes the image back WRITE_FLUSH_TO ms after the 
+         // last write, or WRITE_FLUSH_MAX ms after the first unflushed one
+            Now = ticks();
+            if(!pDisk->bDirty) {
+               pDisk->bDirty = true;
+               pDisk->DirtySince = Now;
             }
-            leds = 0;
-            break;
+            pDisk->LastWrite = Now;
+         }
+      }
+      leds = 0;
+   } while(false);
 
-         case 1:  /* write */
-            leds = LED_GREEN;
-            CopyFromZ80(Buf,pBuf,CPM_SECTOR_SIZE);
-            if((Err = f_write(fp,Buf,CPM_SECTOR_SIZE,&Wrote)) != FR_OK) {
-               ELOG("f_write failed: %d\n",Err);
-               status = 6;
-            }
-            else if(Wrote != CPM_SECTOR_SIZE) {
-               ELOG("Short write failure, wrote %d, requested %d\n",Wrote,
-                    CPM_SECTOR_SIZE);
-               status = 6;
-            }
-            else {
-               gWriteFlushTimeout = ticks_ms() + WRITE_FLUSH_TO;
-               pDisk->bFlushWriteCache = true;
-            }
-            leds = 0;
-            break;
+   if(status != 0) {
+      ELOG("%s command failed, Disk %c T:%d, S:%d, status: %d\n",
+           bWrite ? "Write" : "Read",'A' + StatsDrive,Track,Sector,status);
+   }
+   return status;
+}
+
+static uint32_t SysSnapSum()
+{
+   const uint32_t *p = (const uint32_t *) gSysSnap;
+   uint32_t Sum = 0;
+   uint32_t i;
+
+   for(i = 0; i < gSysSnapLen / sizeof(uint32_t); i++) {
+      Sum = ((Sum << 1) | (Sum >> 31)) + p[i];
+   }
+   return Sum;
+}
 
-         default:    /* illegal command */
-            ELOG("Invalid command 0x%x\n",Data);
-            status = 7;
+// Allocate the system track snapshot for the largest format it's used 
+// with, before resident images can use up LPDDR
+static void SysSnapAlloc()
+{
+   uint32_t Size;
+   uint32_t Max = 0;
+   int i;
+
+   for(i = 0; FormatLookup[i].Desc != NULL; i++) {
+      if(FormatLookup[i].Sectors <= CACHE_LINE_SECTORS) {
+         Size = FormatLookup[i].SysTracks * FormatLookup[i].Sectors *
+                CPM_SECTOR_SIZE;
+         if(Size > Max) {
+            Max = Size;
+         }
+      }
+   }
+   if(gSysSnap == NULL && Max > 0) {
+      gSysSnap = DdrAlloc(Max);
+   }
+}
+
+// Copy the system tracks of drive A (CCP, BDOS and BIOS) into LPDDR
+static void SysSnapCapture()
+{
+   struct dskdef *pDisk = gDisks;
+   FIL *fp = pDisk->fp;
+   uint32_t TrackLen = pDisk->sectors * CPM_SECTOR_SIZE;
+   uint16_t Tracks = FormatLookup[pDisk->Type].SysTracks;
+   uint16_t Track;
+   uint8_t *pData = NULL;
+   FSIZE_t Size;
+   uint32_t Len;
+
+   gSysSnapLen = 0;
+   do {
+      if(fp == NULL || gSysSnap == NULL || Tracks == 0 || 
+         pDisk->sectors > CACHE_LINE_SECTORS)
+      {
+         break;
+      }
+      if(pDisk->bMultiCompDrive) {
+      // The system track comes from the boot file
+         fp = &FpArray[BOOT_FILE_INDEX];
+      }
+   // A Multicomp boot file can end part way through the system track.  
+   // Only the whole sectors it holds are snapshotted, reads of the rest
+   // go to the disk as usual.
+      Size = f_size(fp);
+      if(Size > Tracks * TrackLen) {
+         Size = Tracks * TrackLen;
+      }
+      Size &= ~(FSIZE_t) (CPM_SECTOR_SIZE - 1);
+      memset(gSysSnap,0,Tracks * TrackLen);
+      for(Track = 0; Track * TrackLen < Size; Track++) {
+         pData = CacheRead(0,fp,Track * TrackLen,TrackLen,0);
+         if(pData == NULL) {
             break;
+         }
+         Len = Size - Track * TrackLen;
+         if(Len > TrackLen) {
+            Len = TrackLen;
+         }
+         memcpy(gSysSnap + Track * TrackLen,pData,Len);
       }
+      if(pData == NULL) {
+         break;
+      }
+      gSysSnapTracks = Tracks;
+      gSysSnapLen = Size;
+      gSysSnapSum = SysSnapSum();
+      VLOG("Saved %d system tracks\n",Tracks);
    } while(false);
+}
 
-   gDiskStatus = status;
-   if(status != 0) {
-      ELOG("%s command failed, Disk %c T:%d, S:%d, status: %d\n",
-           Data == 0 ? "Read" : "Write",'A' + Drive,Track,Sector,status);
+// Satisfy FDC_READ_SYSTEM from the snapshot.  Returns false if the request 
+// isn't covered by the snapshot and must be read from the disk.
+static bool SysSnapRead(uint8_t Drive,uint16_t Track,uint16_t Sector,
+                        uint16_t DmaAdr,uint32_t Count)
+{
+   uint32_t Offset;
+   uint32_t Len = Count * CPM_SECTOR_SIZE;
+   bool bRet = false;
+
+   do {
+      if(Drive != 0 || Sector == 0 || Sector > gDisks[0].sectors) {
+         break;
+      }
+      if(gSysSnapLen == 0) {
+         SysSnapCapture();
+      }
+      else if(SysSnapSum() != gSysSnapSum) {
+         ELOG("System track snapshot corrupted\n");
+         SysSnapCapture();
+      }
+      Offset = (Track * gDisks[0].sectors + Sector - 1) * CPM_SECTOR_SIZE;
+      if(gSysSnapLen == 0 || Offset + Len > gSysSnapLen ||
+         DmaAdr + Len > 0x10000)
+      {
+         break;
+      }
+      CopyToZ80(DmaAdr,gSysSnap + Offset,Len);
+      bRet = true;
+   } while(false);
+
+   return bRet;
+}
+
+/*
+ * I/O handler for write FDC command:
+ * transfer sectors in the wanted direction,
+ * 0 = read, 1 = write one sector
+ * 2 = read, 3 = write the number of sectors in the sector count port
+ * 4 = read, 5 = write the entire track (the sector port is ignored)
+ * 6 = read like 2, from a snapshot of drive A's system tracks if possible
+ *
+ * Multi-sector commands transfer consecutive sectors to or from 
+ * consecutive Z80 addresses continuing onto the following track(s) as 
+ * needed.  The transfer stops at the first error.
+ *
+ * The status byte of the FDC is set as follows:
+ *   0 - ok
+ *   1 - illegal drive
+ *   2 - illegal track
+ *   3 - illegal sector
+ *   4 - seek error
+ *   5 - read error
+ *   6 - write error
+ *   7 - illegal command to FDC
+ */
+static void fdco_out(uint8_t Data)
+{
+   uint8_t Drive = z80_drive;
+   uint16_t Track = z80_track;
+   uint16_t Sector = (z80_sector_msb << 8) + z80_sector_lsb;
+   uint16_t DmaAdr = (z80_dma_msb << 8) + z80_dma_lsb;
+   uint32_t Count = 1;
+   bool bWrite = (Data & 1) != 0;
+   uint8_t status = 0;  // Assume the best
+
+   switch(Data) {
+      case FDC_READ:
+      case FDC_WRITE:
+         break;
+
+      case FDC_READ_MULTI:
+      case FDC_WRITE_MULTI:
+         if((Count = z80_sector_count) == 0) {
+            Count = 256;
+         }
+         break;
+
+      case FDC_READ_SYSTEM:
+         if((Count = z80_sector_count) == 0) {
+            Count = 256;
+         }
+         if(SysSnapRead(Drive,Track,Sector,DmaAdr,Count)) {
+            Count = 0;
+         }
+         break;
+
+      case FDC_READ_TRACK:
+      case FDC_WRITE_TRACK:
+         Sector = 1;
+         if(Drive < MAX_LOGICAL_DRIVES) {
+            Count = gDisks[Drive].sectors;
+         }
+         break;
+
+      default:    /* illegal command */
+         ELOG("Invalid command 0x%x\n",Data);
+         status = 7;
+         break;
+   }
+
+   if(Count > 0x10000 / CPM_SECTOR_SIZE) {
+      ELOG("Track too large for command 0x%x\n",Data);
+      status = 7;
    }
+
+   while(status == 0 && Count-- > 0) {
+      status = FdcSector(bWrite,Drive,Track,Sector,DmaAdr,Data == FDC_READ);
+      if(Drive < MAX_LOGICAL_DRIVES && ++Sector > gDisks[Drive].sectors) {
+         Sector = 1;
+         Track++;
+      }
+      DmaAdr += CPM_SECTOR_SIZE;
+   }
+
+   if(bWrite && Data != FDC_WRITE) {
+   // The FPGA only invalidates the sector selected by the sector register
+      z80_sc_clear = 0;
+   }
+   gDiskStatus = status;
 }
 
 // Filename "driveX.dsk" where x= 'a' -> 'p'
@@ -590,7 +925,9 @@ int MountCpmDrive(char *Filename,FSIZE_t ImageSize)
          break;
       }
 
-      if(Drive < 0 || Drive >= MAX_LOGICAL_DRIVES) {
+      if(Drive < 0 || Drive >= MAX_LOGICAL_DRIVES || 
+         gDisks[Drive].pRam != NULL)
+      {
          ELOG("Can't mount '%s', invalid drive\n",Filename);
          break;
       }
@@ -615,6 +952,11 @@ int MountCpmDrive(char *Filename,FSIZE_t ImageSize)
       }
       gMountedDrives++;
       gDisks[Drive].fp = Fp;
+      ImageMap(Fp,Filename);
+   // Most of a 512 MB drive is never written, don't read it to find out
+      if(gDisks[Drive].Type == DSK_Z80PACK_512MB) {
+         SparseMapOpen(Fp,Filename,CACHE_LINE_SIZE);
+      }
       LOG("Mounted %s image on %c:\n",FormatLookup[gDisks[Drive].Type].Desc,
           'A' + Drive);
       Ret = 0;
@@ -623,42 +965,186 @@ int MountCpmDrive(char *Filename,FSIZE_t ImageSize)
    return Ret;
 }
 
+// Filename "driveX.ram" where x= 'i' or 'j'.  The file's contents are 
+// ignored, drive X becomes a freshly formatted 4 MB z80pack hard disk in 
+// LPDDR.  It's lost on power down.  Only I: and J: have the 4 MB hard disk
+// geometry in the z80pack and dual mode BIOSes.
+int MountRamDrive(char *Filename)
+{
+   int Drive = Filename[5] - 'A';
+   const DiskType Type = DSK_Z80PACK_4MB;
+   uint8_t *pRam;
+   int Ret = 1;
+
+   do {
+      if((Drive != 'I' - 'A' && Drive != 'J' - 'A') ||
+         gDisks[Drive].fp != NULL || gDisks[Drive].pRam != NULL)
+      {
+         ELOG("Can't mount '%s', invalid drive\n",Filename);
+         break;
+      }
+
+      if((pRam = DdrAlloc(FormatLookup[Type].FileSize)) == NULL) {
+         ELOG("Couldn't allocate RAM drive\n");
+         break;
+      }
+      memset(pRam,0xe5,FormatLookup[Type].FileSize);
+      gDisks[Drive].sectors = FormatLookup[Type].Sectors;
+      gDisks[Drive].tracks = FormatLookup[Type].Tracks;
+      gDisks[Drive].Type = Type;
+      gDisks[Drive].pRam = pRam;
+      LOG("Mounted %s RAM drive on %c:\n",FormatLookup[Type].Desc,
+          'A' + Drive);
+      Ret = 0;
+   } while(false);
+
+   return Ret;
+}
+
+static bool BootCopyAlloc()
+{
+   if(gBootCopy == NULL) {
+      gBootCopy = DdrAlloc(BOOT_COPY_SIZE);
+   }
+   return gBootCopy != NULL;
+}
+
+// Restore Z80 RAM from the copy of the last image loaded.  Returns false 
+// if there isn't one.  The copy may still be running when this returns, 
+// DmaWait() before releasing the Z80 from reset.
+bool RestoreBootImage()
+{
+   uint32_t Len = gBootCopyLen & ~3;
+
+   if(gBootCopyLen == 0) {
+      return false;
+   }
+   VLOG("Restoring %d bytes\n",gBootCopyLen);
+   if(!DmaCopyStart((void *) Z80_MEMORY32_ADR,gBootCopy,Len)) {
+      Len = 0;
+   }
+   CopyToZ80(Len,gBootCopy + Len,gBootCopyLen - Len);
+   return true;
+}
+
+// Store part of the image being loaded in the boot copy, or directly in 
+// Z80 RAM if there isn't one
+static void LoadStore(uint32_t Adr,const uint8_t *pData,uint32_t Len)
+{
+   if(gBootCopy != NULL) {
+      memcpy(gBootCopy + Adr,pData,Len);
+   }
+   else {
+      CopyToZ80(Adr,pData,Len);
+   }
+}
+
+// Load BOOT.IMG into Z80 RAM.  Reads are cluster aligned and go directly 
+// into the boot copy which is then copied to Z80 RAM in one transfer.  If
+// the boot copy couldn't be allocated the image is loaded directly into 
+// Z80 RAM a sector at a time and can't be restored on reset.
 int LoadImage(const char *Filename,FSIZE_t Len)
 {
    FIL File;
    FIL *Fp = &File;
    FRESULT Err;
-   uint8_t Buf[CPM_SECTOR_SIZE];
-   int Bytes2Read;
-   int BytesRead = 0;
    UINT Read;
-   uint8_t *pBuf = (uint8_t *) Z80_MEMORY_ADR;
    bool bFileOpen = false;
+   uint8_t Buf[FF_MIN_SS];
+   uint8_t Jump[3];
+   BootHeader *pHeader = (BootHeader *) Buf;
+   uint32_t HeadLen = Len < FF_MIN_SS ? Len : FF_MIN_SS;
+   uint32_t HeaderLen = 0;
+   uint32_t LoadAdr = 0;
+   uint32_t StartAdr = 0;
+   uint32_t ClusterLen;
+   uint32_t Chunk;
+   uint32_t Adr;
 
    do {
+      if(!BootCopyAlloc()) {
+         ELOG("No boot copy, %s won't be restored on reset\n",Filename);
+      }
       if((Err = f_open(Fp,Filename,FA_READ)) != FR_OK) {
          ELOG("Couldn't open %s, %d\n",Filename,Err);
          break;
       }
       bFileOpen = true;
-      while(BytesRead < Len) {
-         Bytes2Read = Len - BytesRead;
-         if(Bytes2Read > sizeof(Buf)) {
-            Bytes2Read = sizeof(Buf);
+      ClusterLen = Fp->obj.fs->csize * FF_MIN_SS;
+      if(ClusterLen > LOAD_CHUNK_MAX) {
+         ClusterLen = LOAD_CHUNK_MAX;
+      }
+   // The first sector is read separately for the header, the rest of the 
+   // image is read in whole sectors
+      if((Err = f_read(Fp,Buf,HeadLen,&Read)) != FR_OK) {
+         ELOG("f_read failed: %d\n",Err);
+         break;
+      }
+      if(Read != HeadLen) {
+         ELOG("Short read failure, read %d, requested %d\n",Read,HeadLen);
+         Err = -1;
+         break;
+      }
+      if(HeadLen >= sizeof(BootHeader) && pHeader->Magic == BOOT_HDR_MAGIC) {
+         HeaderLen = sizeof(BootHeader);
+         LoadAdr = pHeader->LoadAdr;
+         StartAdr = pHeader->StartAdr;
+      }
+      Len -= HeaderLen;
+   // A jump to the start address is written at 0, don't overwrite the image
+      if(LoadAdr + Len > BOOT_COPY_SIZE || (StartAdr != 0 && LoadAdr < 3)) {
+         ELOG("Can't load %s, %d bytes @ 0x%x, start 0x%x\n",Filename,
+              Len,LoadAdr,StartAdr);
+         Err = -1;
+         break;
+      }
+      LOG("Loading %d bytes @ 0x%x, start 0x%x\n",Len,LoadAdr,StartAdr);
+      if(gBootCopy != NULL) {
+         memset(gBootCopy,0,LoadAdr);
+      }
+      else {
+         for(Adr = 0; Adr < LoadAdr; Adr++) {
+            *((volatile uint8_t *) (Z80_MEMORY32_ADR + Adr)) = 0;
          }
-         if((Err = f_read(Fp,&Buf,Bytes2Read,&Read)) != FR_OK) {
+      }
+      if(StartAdr != 0) {
+         Jump[0] = 0xc3;    // JP StartAdr
+         Jump[1] = (uint8_t) StartAdr;
+         Jump[2] = (uint8_t) (StartAdr >> 8);
+         LoadStore(0,Jump,sizeof(Jump));
+      }
+      LoadStore(LoadAdr,Buf + HeaderLen,HeadLen - HeaderLen);
+      Adr = LoadAdr + HeadLen - HeaderLen;
+
+      while(Adr < LoadAdr + Len) {
+      // End each read on a cluster boundary
+         Chunk = ClusterLen - (f_tell(Fp) % ClusterLen);
+         if(Chunk > LoadAdr + Len - Adr) {
+            Chunk = LoadAdr + Len - Adr;
+         }
+         if(gBootCopy == NULL && Chunk > sizeof(Buf)) {
+            Chunk = sizeof(Buf);
+         }
+         if((Err = f_read(Fp,gBootCopy != NULL ? gBootCopy + Adr : Buf,Chunk,
+                          &Read)) != FR_OK)
+         {
             ELOG("f_read failed: %d\n",Err);
             break;
          }
-         else if(Read != Bytes2Read) {
-            ELOG("Short read failure, read %d, requested %d\n",Read,
-                 Bytes2Read);
+         if(Read != Chunk) {
+            ELOG("Short read failure, read %d, requested %d\n",Read,Chunk);
             Err = -1;
             break;
          }
-         CopyToZ80(pBuf,Buf,Read);
-         BytesRead += Bytes2Read;
-         pBuf += Bytes2Read << 2;
+         if(gBootCopy == NULL) {
+            CopyToZ80(Adr,Buf,Chunk);
+         }
+         Adr += Chunk;
+      }
+      if(Err == FR_OK && gBootCopy != NULL) {
+         CopyToZ80(0,gBootCopy,Adr);
+         gBootCopyLen = Adr;
+         gBootCopyIsSector = false;
       }
    } while(false);
 
@@ -678,7 +1164,6 @@ void LoadDefaultBoot()
    FIL *fp = gMountMode == MAP_Z80PACK ? gDisks[0].fp : gSystemFp;
    uint8_t Buf[CPM_SECTOR_SIZE];
    UINT Read;
-   void *pBuf = (void *) Z80_MEMORY_ADR;
    FRESULT Err;
 
    do {
@@ -699,7 +1184,12 @@ void LoadDefaultBoot()
       LOG("Boot sector:\n");
       LOG_HEX(Buf,CPM_SECTOR_SIZE);
 #endif
-      CopyToZ80(pBuf,Buf,CPM_SECTOR_SIZE);
+      CopyToZ80(0,Buf,CPM_SECTOR_SIZE);
+      if(BootCopyAlloc()) {
+         memcpy(gBootCopy,Buf,CPM_SECTOR_SIZE);
+         gBootCopyLen = CPM_SECTOR_SIZE;
+         gBootCopyIsSector = true;
+      }
    } while(false);
 }
 
@@ -757,22 +1247,86 @@ void LogHex(char *LogFlags,void *Data,int Len)
 
 void FlushWriteCache()
 {
+   int Err;
    int i;
-   FRESULT Err;
 
+   gFlushFp = NULL;
+   Err = CacheFlush();
    for(i = 0; i < MAX_LOGICAL_DRIVES; i++) {
-      if(gDisks[i].bFlushWriteCache) {
-         gDisks[i].bFlushWriteCache = false;
-         if(gDisks[i].bMultiCompDrive) {
-            LOG("Flushing Multicomp write cache\n");
+   // Blocks that couldn't be written are still in the cache
+      gDisks[i].bDirty = Err != 0 && gDisks[i].bDirty && 
+                         CacheDirtyBlocks(gDisks[i].fp) != 0;
+   }
+   if(Err != 0) {
+      ELOG("Write cache flush failed\n");
+   }
+}
+
+// True when the Z80 is stalled on an I/O request other than the console 
+// input we're already waiting in
+static bool Z80IoPending()
+{
+   uint32_t IoState = z80_io_state & IO_STATE_MASK;
+
+   return IoState == IO_STAT_READ || IoState == IO_STAT_WRITE ||
+          z80_con_out_count != 0;
+}
+
+// Write back dirty images a few blocks at a time while the Z80 doesn't need
+// us.  An image is flushed once it has been idle for WRITE_FLUSH_TO ms or 
+// has had unflushed writes for WRITE_FLUSH_MAX ms.  The flush resumes where
+// it left off on the next call if the Z80 makes an I/O request.  Times are
+// raw ticks() compared by difference so they survive the counter wrapping.
+void FlushPoll()
+{
+   uint32_t Now = ticks();
+   struct dskdef *pDisk;
+   int Remaining = 1;
+   bool Dirty;
+   int i;
+
+   if(gFlushFp == NULL) {
+      for(i = 0; i < MAX_LOGICAL_DRIVES; i++) {
+         pDisk = &gDisks[i];
+         if(pDisk->bDirty && 
+            (Now - pDisk->LastWrite >= WRITE_FLUSH_TO * 1000 * CYCLE_PER_US ||
+             Now - pDisk->DirtySince >= WRITE_FLUSH_MAX * 1000 * CYCLE_PER_US))
+         {
+            gFlushFp = pDisk->fp;
+            gFlushStart = Now;
+            CacheFlushStart(gFlushFp);
+            break;
          }
-         else {
-            LOG("Flushing write cache drive %c\n",'A' + i);
+      }
+      if(gFlushFp == NULL) {
+         if(!Z80IoPending()) {
+            SparseMapPoll();
          }
-         if((Err = f_sync(gDisks[i].fp)) != FR_OK) {
-            ELOG("f_sync failed: %d\n",Err);
+         return;
+      }
+   }
+
+   while(!Z80IoPending()) {
+      if((Remaining = CacheFlushSlice(FLUSH_SLICE_BLOCKS)) <= 0) {
+         break;
+      }
+   }
+
+   if(Remaining <= 0) {
+      if(Remaining < 0) {
+         ELOG("Write cache flush failed\n");
+      }
+   // Blocks written after the flush started or that couldn't be written 
+   // are still in the cache
+      Dirty = CacheDirtyBlocks(gFlushFp) != 0;
+      for(i = 0; i < MAX_LOGICAL_DRIVES; i++) {
+         pDisk = &gDisks[i];
+         if(pDisk->fp == gFlushFp && pDisk->bDirty) {
+            pDisk->bDirty = Dirty;
+            pDisk->DirtySince = gFlushStart;
          }
       }
+      gFlushFp = NULL;
    }
 }
 
@@ -897,6 +1451,7 @@ MapMode MountBootDrive()
             break;
          }
          LOG("%s opened successfully\n",Filename);
+         ImageMap(Fp,Filename);
          if(Mode[BootFile] == MAP_Z80PACK) {
             gDisks[0].fp = Fp;
          }
@@ -935,6 +1490,26 @@ MapMode MountBootDrive()
 // (*) The system track from the SD card image is replaced by the 
 //     I/O processor on the fly with data from the dual.dsk image.
 // 
+#ifdef RESIDENT_IMAGE_MAX
+// Load small images into LPDDR.  Called after all drives are mounted so
+// RAM drives and other allocations made while mounting come first.
+static void LoadResidentImages()
+{
+   struct dskdef *pDisk;
+   int i;
+
+   for(i = 0; i < MAX_LOGICAL_DRIVES; i++) {
+      pDisk = &gDisks[i];
+      if(pDisk->fp != NULL && !pDisk->bMultiCompDrive &&
+         pDisk->Type != DSK_Z80PACK_512MB &&
+         f_size(pDisk->fp) <= RESIDENT_IMAGE_MAX)
+      {
+         CacheLoadImage(pDisk->fp);
+      }
+   }
+}
+#endif
+
 int MountCpmDrives()
 {
    char *cp;
@@ -953,6 +1528,10 @@ int MountCpmDrives()
    struct dskdef *pDisk;
 
    do {
+      z80_sc_clear = 0;
+   // Fixed size LPDDR buffers first, resident images get what's left
+      BootCopyAlloc();
+      SysSnapAlloc();
       gMountMode = MountBootDrive();
       LOG("gMountMode %d\n",gMountMode);
       if(gMountMode == MAP_ERROR || gMountMode == MAP_NONE) {
@@ -983,6 +1562,12 @@ int MountCpmDrives()
             cp++;
          }
          Drive = cp[-1];
+         if(strstr(Filename,"DRIVE") != 0 && strstr(cp,".RAM") != 0 &&
+            gMountMode != MAP_MULTICOMP)
+         {
+            MountRamDrive(Filename);
+            continue;
+         }
          switch(gMountMode) {
             case MAP_Z80PACK:
                if(strstr(Filename,"DRIVE") != 0 && strstr(cp,".DSK") != 0 &&
@@ -1066,6 +1651,7 @@ int MountCpmDrives()
          break;
       }
       gMountedDrives++;
+      ImageMap(Fp,Filename);
 
       MultiCompDrives = Files[Choice].fsize / MULTICOMP_DRIVE_SIZE;
       if(gMountMode == MAP_MULTICOMP) {
@@ -1082,6 +1668,7 @@ int MountCpmDrives()
       pDisk = gDisks;
       for(i = 0; i < MultiCompDrives; i++) {
          pDisk->fp = Fp;
+         pDisk->pRam = NULL;
          pDisk->bMultiCompDrive = true;
          pDisk->sectors = 128;
          pDisk->tracks = 512;
@@ -1115,6 +1702,13 @@ int MountCpmDrives()
    }
    #undef MAX_FILES
 
+#ifdef RESIDENT_IMAGE_MAX
+   LoadResidentImages();
+#endif
+   if(Ret == 0) {
+      SysSnapCapture();
+   }
+
    return Ret;
 }
 
@@ -1123,7 +1717,9 @@ void ListMountedDrives(DiskType Type)
    bool First = true;
    int i;
    for(i = 0; i < MAX_LOGICAL_DRIVES; i++) {
-      if(gDisks[i].fp != NULL && gDisks[i].Type == Type) {
+      if((gDisks[i].fp != NULL || gDisks[i].pRam != NULL) && 
+         gDisks[i].Type == Type)
+      {
          if(First) {
             First = false;
             ALOG_R("%s: ",DiskTypeDesc[Type]);
@@ -24,6 +24,7 @@
 #ifndef _CPM_IO_H_
 #define _CPM_IO_H_
 
+#include <stdbool.h>
 #include "ff.h"
 
 #define SCREEN_X    80
@@ -31,12 +32,14 @@
 
 #define MAX_MOUNTED_DRIVES    6
 #define MAX_LOGICAL_DRIVES    16 // A: -> P: 
+#define CPM_SECTOR_SIZE       128
 
 #define DLY_TAP_ADR        0x03000000
 #define LEDS_ADR           0x03000004
 #define Z80_RST_ADR        0x0300000c
 #define UART_ADR           0x03000100
-#define Z80_MEMORY_ADR     0x05000000
+#define Z80_MEMORY_ADR     0x05000000   // one Z80 byte per 32 bit word
+#define Z80_MEMORY32_ADR   0x05100000   // packed, 4 Z80 bytes per word
 #define VRAM_ADR           0x08000000
 
 #define VRAM              *((volatile uint32_t *)VRAM_ADR)
@@ -55,28 +58,52 @@
 #define z80_drive          Z80_INTERFACE(0x4)
 #define z80_track          Z80_INTERFACE(0x8)
 #define z80_sector_lsb     Z80_INTERFACE(0xc)
+#define z80_sc_clear       IO_INTERFACE(0x10)   // Invalidate sector cache
 #define z80_dma_lsb        Z80_INTERFACE(0x14)
 #define z80_dma_msb        Z80_INTERFACE(0x18)
 #define z80_sector_msb     Z80_INTERFACE(0x1c)
+#define z80_sector_count   Z80_INTERFACE(0x1d)  // sectors for FDC_xxx_MULTI
 #define z80_io_adr         Z80_INTERFACE(0x20)  // I/O address of current in or out
 #define z80_out_data       Z80_INTERFACE(0x24)  // Data output from Z80
 #define z80_in_data        Z80_INTERFACE(0x28)  // Data input to Z80
 #define z80_io_state       IO_INTERFACE(0x2c)
+#define z80_con_out_data   IO_INTERFACE(0x40)   // R: pops console output
+#define z80_con_out_count  IO_INTERFACE(0x44)
+#define z80_con_in_data    IO_INTERFACE(0x48)   // W: queues console input
+#define z80_con_in_count   IO_INTERFACE(0x4c)
+#define z80_trap_latency   IO_INTERFACE(0x50)   // 32 clock units, W: clears
+#define CON_IN_COUNT_MASK  0x1ff
+#define CON_IN_WANTED      0x200    // Z80 is waiting for console input
+#define CON_OUT_FIFO_SIZE  256
+#define CON_IN_FIFO_SIZE   256
 #define font_fg_color      IO_INTERFACE(0x30)
 #define font_bg_color      IO_INTERFACE(0x34)
+#define z80_sc_data        IO_INTERFACE(0x38)   // Sector cache fill data
+#define z80_sc_tag         IO_INTERFACE(0x3c)   // W: fill tag, R: hit count
 
 #define IO_STAT_IDLE    0
 #define IO_STAT_WRITE   1
 #define IO_STAT_READ    2
 #define IO_STAT_READY   3
+#define IO_STAT_DMA     4  // sector cache hit being copied to Z80 RAM
 #define IO_STATE_MASK   0x7
 #define IO_STAT_HALTED  0x800000
 
+// FDC commands (port 13), bit 0 set for writes
+#define FDC_READ           0
+#define FDC_WRITE          1
+#define FDC_READ_MULTI     2  // sector count port sectors (0 = 256)
+#define FDC_WRITE_MULTI    3
+#define FDC_READ_TRACK     4  // all sectors of the track
+#define FDC_WRITE_TRACK    5
+#define FDC_READ_SYSTEM    6  // FDC_READ_MULTI from the system track snapshot
+
 #define BLACK           0
 #define WHITE           0xffffff
 #define GREEN           0x00ff00
 
 #define INIT_IMAGE_FILENAME   "BOOT.IMG"
+#define BOOT_HDR_MAGIC        0x4930385a  // "Z80I"
 
 typedef enum {
    MAP_ERROR = -1,
@@ -88,7 +115,6 @@ typedef enum {
 
 extern int gMountedDrives;
 extern unsigned char gFunctionRequest;
-extern uint32_t gWriteFlushTimeout;
 extern DWORD gBootImageLen;
 extern FIL *gSystemFp;
 extern MapMode gMountMode;
@@ -98,11 +124,15 @@ int MountCpmDrives();
 int LoadImage(const char *Filename,FSIZE_t Len);
 void HandleIoIn(uint8_t IoPort);
 void HandleIoOut(uint8_t IoPort,uint8_t Data);
+void ConsoleOutPoll(void);
+void ConsoleInPoll(void);
 void Z80MemTest(void);
 void LoadDefaultBoot(void);
+bool RestoreBootImage(void);
 void UartPutc(char c);
 void PrintfPutc(char c);
 void FlushWriteCache(void);
+void FlushPoll(void);
 void IdlePoll(void);
 void DisplayString(const char *Msg,int Row,int Col);
 #endif // _CPM_IO_H_
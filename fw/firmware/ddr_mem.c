@@ -0,0 +1,73 @@
+/*
+ *  ddr_mem.c
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Trivial allocator for the 16 MB of LPDDR.  
+ *
+ * The firmware's .data and .bss sections live at the bottom of the LPDDR 
+ * and the stack is in internal RAM so everything from _heap_start up to 
+ * the top of the LPDDR is available for large buffers such as disk caches.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "ddr_mem.h"
+
+// #define DEBUG_LOGGING
+// #define VERBOSE_DEBUG_LOGGING
+#include "log.h"
+
+#define DDR_ALIGNMENT   32
+
+#define DDR_ALIGN(x)    (((x) + DDR_ALIGNMENT - 1) & ~(DDR_ALIGNMENT - 1))
+
+extern uint8_t _heap_start[];
+static uint8_t *gDdrNext;
+
+void *DdrAlloc(uint32_t Size)
+{
+   uint8_t *Ret = NULL;
+
+   Size = DDR_ALIGN(Size);
+
+   if(Size > DdrAvailable()) {
+      ELOG("Unable to allocate %d bytes, %d available\n",Size,DdrAvailable());
+   }
+   else {
+      Ret = gDdrNext;
+      gDdrNext += Size;
+      LOG("Allocated %d bytes @ 0x%x\n",Size,(unsigned int) Ret);
+   }
+
+   return Ret;
+}
+
+uint32_t DdrAvailable()
+{
+   if(gDdrNext == NULL) {
+      gDdrNext = (uint8_t *) DDR_ALIGN((uint32_t) _heap_start);
+   }
+   return (uint32_t) (DDR_ADR + DDR_SIZE) - (uint32_t) gDdrNext;
+}
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 3
+ * End:
+ */
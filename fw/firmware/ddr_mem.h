@@ -0,0 +1,33 @@
+/*
+ *  ddr_mem.h
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#ifndef _DDR_MEM_H_
+#define _DDR_MEM_H_
+
+#include <stdint.h>
+
+#define DDR_ADR         0x0C000000
+#define DDR_SIZE        (16*1024*1024)
+
+// Allocate a block of LPDDR above the end of .bss.  There is no free, 
+// allocations are expected to be made once at mount time.
+void *DdrAlloc(uint32_t Size);
+uint32_t DdrAvailable(void);
+
+#endif   // _DDR_MEM_H_
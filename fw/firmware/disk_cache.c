@@ -0,0 +1,698 @@
+/*
+ *  disk_cache.c
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Track read cache for CP/M disk images.
+ *
+ * CP/M reads are almost always sequential within a track so on a miss the
+ * blocks containing the entire track are read with a single multi-block 
+ * disk_read directly into the cache line (one per extent if the track 
+ * spans a fragment boundary).  Subsequent reads from the same track are 
+ * served from LPDDR without any USB traffic.
+ *
+ * Cache lines are keyed by the image's FIL and the offset of the start of 
+ * the track within the image so the Multicomp drives which share a single
+ * image file don't need any special handling.
+ *
+ * Writes are absorbed by a write back cache of 512 byte image blocks which
+ * tracks which 128 byte CP/M sectors within each block are dirty.  When the 
+ * cache is flushed the dirty blocks are sorted and written in runs of 
+ * contiguous LBAs, each run contained within a single flash erase block.
+ * Blocks which are only partially dirty are completed from the track cache
+ * or by reading the block from the image before they are written.
+ *
+ * The track cache is kept coherent by writes so it always contains the 
+ * latest data.  When a track is read from the image any dirty sectors 
+ * within it are copied from the write back cache.
+ *
+ * Images with a sparse map (see sparse_map.c) skip the read entirely for 
+ * lines which are known to be blank.
+ *
+ * Small images can be made resident: the entire image is read into LPDDR 
+ * when it's mounted and all reads are served from there.  Writes update 
+ * the resident copy and go through the write back cache as usual so they
+ * are written back to the image in the background.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "string.h"
+
+#include "ff.h"
+#include "misc.h"
+#include "cpm_io.h"
+#include "disk_cache.h"
+#include "ddr_mem.h"
+#include "disk_image.h"
+#include "sparse_map.h"
+
+// #define DEBUG_LOGGING
+// #define LOG_TO_BOTH
+// #define VERBOSE_DEBUG_LOGGING
+#include "log.h"
+
+typedef struct {
+   FIL *fp;          // NULL: block not in use
+   uint32_t Block;   // offset of the block within the image / WB_BLOCK_SIZE
+   int16_t Next;     // next block in hash chain or free list, -1: end
+   uint8_t DirtyMask;// bit per CP/M sector
+   uint8_t *pData;   // block data in LPDDR
+} WbBlock;
+
+typedef struct {
+   FIL *fp;          // NULL: line not in use
+   FSIZE_t Pos;      // offset of the first byte of the line within the image
+   uint32_t Len;     // bytes
+   uint32_t LastUse;
+   uint8_t *pData;   // line data in LPDDR
+   uint8_t *pBuf;    // start of the block aligned buffer containing pData
+} CacheLine;
+
+CacheStats gCacheStats[MAX_LOGICAL_DRIVES];
+
+static CacheLine gLines[CACHE_LINES];
+static CacheLine *gLastHit;
+static uint32_t gUseCount;
+
+static WbBlock gWbBlocks[WB_BLOCKS];
+static int16_t gWbHash[WB_HASH_SIZE];
+static int16_t gWbFree;
+static int gWbDirtyBlocks;
+typedef struct {
+   FIL *fp;
+   uint8_t *pData;   // entire image in LPDDR
+} Resident;
+
+static int16_t gFlushList[WB_BLOCKS];
+static uint8_t *gFlushBuf;
+// Incremental flush in progress: gFlushList[gSlicePos .. gSliceCount - 1]
+// are the blocks of gSliceFp still to be written
+static FIL *gSliceFp;
+static int gSliceCount;
+static int gSlicePos;
+static bool gSliceErr;
+// One per FpArray entry
+static Resident gResident[MAX_MOUNTED_DRIVES + 1];
+
+static void WbOverlay(FIL *fp,FSIZE_t Pos,uint8_t *pData,uint32_t Len);
+
+int DiskCacheInit()
+{
+   int i;
+   int Ret = 0;
+   uint8_t *pData = DdrAlloc(CACHE_LINES * CACHE_LINE_BUF_SIZE);
+   uint8_t *pWbData = DdrAlloc(WB_BLOCKS * WB_BLOCK_SIZE);
+
+   gFlushBuf = DdrAlloc(ERASE_BLOCK_SIZE);
+   if(pData == NULL || pWbData == NULL || gFlushBuf == NULL) {
+      ELOG("Couldn't allocate disk cache\n");
+      Ret = 1;
+   }
+   else {
+      for(i = 0; i < CACHE_LINES; i++) {
+         gLines[i].fp = NULL;
+         gLines[i].pBuf = pData;
+         pData += CACHE_LINE_BUF_SIZE;
+      }
+      for(i = 0; i < WB_HASH_SIZE; i++) {
+         gWbHash[i] = -1;
+      }
+      for(i = 0; i < WB_BLOCKS; i++) {
+         gWbBlocks[i].fp = NULL;
+         gWbBlocks[i].pData = pWbData;
+         gWbBlocks[i].Next = i + 1 < WB_BLOCKS ? i + 1 : -1;
+         pWbData += WB_BLOCK_SIZE;
+      }
+      gWbFree = 0;
+   }
+   return Ret;
+}
+
+static uint8_t *ResidentLookup(FIL *fp)
+{
+   int i;
+
+   for(i = 0; i < MAX_MOUNTED_DRIVES + 1; i++) {
+      if(gResident[i].fp == fp) {
+         return gResident[i].pData;
+      }
+   }
+   return NULL;
+}
+
+// Read an entire image into LPDDR.  Returns 0 on success, on failure the 
+// image is accessed through the track cache as usual.
+int CacheLoadImage(FIL *fp)
+{
+   Resident *p = NULL;
+   uint32_t Len = (f_size(fp) + WB_BLOCK_SIZE - 1) & ~(WB_BLOCK_SIZE - 1);
+#ifdef DEBUG_LOGGING
+   uint32_t Start = ticks_ms();
+#endif
+   int i;
+   int Ret = 1;
+
+   do {
+      for(i = 0; i < MAX_MOUNTED_DRIVES + 1; i++) {
+         if(gResident[i].fp == NULL) {
+            p = &gResident[i];
+            break;
+         }
+      }
+      if(p == NULL || DdrAvailable() < Len + RESIDENT_RESERVE) {
+         LOG("Not enough LPDDR to load image\n");
+         break;
+      }
+      if((p->pData = DdrAlloc(Len)) == NULL) {
+         break;
+      }
+      leds = LED_GREEN;
+      Ret = ImageRead(fp,0,p->pData,Len);
+      leds = 0;
+      if(Ret == 0) {
+         LOG("Loaded %d bytes in %d ms\n",Len,ticks_ms() - Start);
+         p->fp = fp;
+      }
+   } while(false);
+
+   return Ret;
+}
+
+static CacheLine *CacheLookup(FIL *fp,FSIZE_t Pos)
+{
+   CacheLine *pLine = gLastHit;
+   int i;
+
+   if(pLine == NULL || pLine->fp != fp || Pos < pLine->Pos || 
+      Pos >= pLine->Pos + pLine->Len)
+   {
+      pLine = NULL;
+      for(i = 0; i < CACHE_LINES; i++) {
+         if(gLines[i].fp == fp && Pos >= gLines[i].Pos && 
+            Pos < gLines[i].Pos + gLines[i].Len)
+         {
+            pLine = &gLines[i];
+            break;
+         }
+      }
+   }
+
+   return pLine;
+}
+
+// Return a pointer to the cached copy of the sector at LinePos + Offset,
+// reading the line containing it if necessary.  Returns NULL on error.
+uint8_t *CacheRead(int Drive,FIL *fp,FSIZE_t LinePos,uint32_t LineLen,
+                   uint32_t Offset)
+{
+   CacheLine *pLine;
+   CacheLine *pVictim;
+   FSIZE_t BlockPos;
+   uint32_t BlockLen;
+   uint8_t *Ret = NULL;
+   int Fill;
+   int i;
+
+   if((Ret = ResidentLookup(fp)) != NULL) {
+      gCacheStats[Drive].ReadHits++;
+      return Ret + LinePos + Offset;
+   }
+
+   do {
+      if((pLine = CacheLookup(fp,LinePos + Offset)) != NULL) {
+         gCacheStats[Drive].ReadHits++;
+         Ret = pLine->pData + (LinePos + Offset - pLine->Pos);
+         break;
+      }
+      gCacheStats[Drive].ReadMisses++;
+
+   // Pick an unused or the least recently used line
+      pVictim = &gLines[0];
+      for(i = 0; i < CACHE_LINES; i++) {
+         if(gLines[i].fp == NULL) {
+            pVictim = &gLines[i];
+            break;
+         }
+         if(gLines[i].LastUse < pVictim->LastUse) {
+            pVictim = &gLines[i];
+         }
+      }
+      pLine = pVictim;
+      pLine->fp = NULL;
+
+   // The system track of a Multicomp drive comes from the boot image
+   // which is shorter than a track
+      if(LinePos + LineLen > f_size(fp)) {
+         LineLen = f_size(fp) - LinePos;
+      }
+      if(LineLen > CACHE_LINE_SIZE || Offset + CPM_SECTOR_SIZE > LineLen) {
+         ELOG("Invalid line length %d\n",LineLen);
+         break;
+      }
+
+   // Tracks aren't necessarily block aligned (26 sector floppies), read
+   // the blocks containing the track
+      BlockPos = LinePos & ~(FSIZE_t) (WB_BLOCK_SIZE - 1);
+      BlockLen = (LinePos + LineLen - BlockPos + WB_BLOCK_SIZE - 1) & 
+                 ~(WB_BLOCK_SIZE - 1);
+      pLine->pData = pLine->pBuf + (LinePos - BlockPos);
+      if((Fill = SparseMapLookup(fp,LinePos)) >= 0) {
+         gCacheStats[Drive].BlankReads++;
+         memset(pLine->pData,Fill,LineLen);
+      }
+      else {
+         if(ImageRead(fp,BlockPos,pLine->pBuf,BlockLen) != 0) {
+            break;
+         }
+         VLOG("Read %d bytes @ 0x%x\n",LineLen,LinePos);
+         SparseMapLearn(fp,LinePos,pLine->pData,LineLen);
+      }
+      WbOverlay(fp,LinePos,pLine->pData,LineLen);
+      pLine->fp = fp;
+      pLine->Pos = LinePos;
+      pLine->Len = LineLen;
+      Ret = pLine->pData + Offset;
+   } while(false);
+
+   if(Ret != NULL) {
+      pLine->LastUse = ++gUseCount;
+      gLastHit = pLine;
+   }
+
+   return Ret;
+}
+
+static int WbHash(FIL *fp,uint32_t Block)
+{
+   return (Block ^ ((uint32_t) fp >> 4)) & (WB_HASH_SIZE - 1);
+}
+
+static WbBlock *WbLookup(FIL *fp,uint32_t Block)
+{
+   int i = gWbHash[WbHash(fp,Block)];
+   WbBlock *p;
+
+   while(i >= 0) {
+      p = &gWbBlocks[i];
+      if(p->fp == fp && p->Block == Block) {
+         return p;
+      }
+      i = p->Next;
+   }
+   return NULL;
+}
+
+// Copy any dirty sectors within Pos -> Pos + Len into pData
+static void WbOverlay(FIL *fp,FSIZE_t Pos,uint8_t *pData,uint32_t Len)
+{
+   uint32_t Block;
+   uint32_t LastBlock;
+   FSIZE_t SlotPos;
+   WbBlock *p;
+   int Slot;
+
+   if(gWbDirtyBlocks == 0) {
+      return;
+   }
+   LastBlock = (Pos + Len - 1) / WB_BLOCK_SIZE;
+   for(Block = Pos / WB_BLOCK_SIZE; Block <= LastBlock; Block++) {
+      if((p = WbLookup(fp,Block)) == NULL) {
+         continue;
+      }
+      for(Slot = 0; Slot < WB_SLOTS; Slot++) {
+         SlotPos = Block * WB_BLOCK_SIZE + Slot * CPM_SECTOR_SIZE;
+         if((p->DirtyMask & (1 << Slot)) && SlotPos >= Pos && 
+            SlotPos + CPM_SECTOR_SIZE <= Pos + Len)
+         {
+            memcpy(pData + (SlotPos - Pos),p->pData + Slot * CPM_SECTOR_SIZE,
+                   CPM_SECTOR_SIZE);
+         }
+      }
+   }
+}
+
+// Write a sector to the write back cache and update the cached copy in the
+// track cache if there is one.  Returns 0 on success.
+int CacheWrite(int Drive,FIL *fp,FSIZE_t Pos,const uint8_t *Data)
+{
+   CacheLine *pLine;
+   WbBlock *p;
+   uint8_t *pResident;
+   uint32_t Block = Pos / WB_BLOCK_SIZE;
+   int Slot = (Pos % WB_BLOCK_SIZE) / CPM_SECTOR_SIZE;
+   int Hash;
+   int i;
+   int Ret = 0;
+
+   do {
+      if(!(fp->flag & FA_WRITE)) {
+         ELOG("Image is read only\n");
+         Ret = 1;
+         break;
+      }
+      gCacheStats[Drive].Writes++;
+      SparseMapWrite(fp,Pos);
+      if((p = WbLookup(fp,Block)) != NULL) {
+         gCacheStats[Drive].WriteHits++;
+      }
+      else {
+         if(gWbFree < 0 && (Ret = CacheFlush()) != 0) {
+            break;
+         }
+         i = gWbFree;
+         p = &gWbBlocks[i];
+         gWbFree = p->Next;
+         Hash = WbHash(fp,Block);
+         p->fp = fp;
+         p->Block = Block;
+         p->DirtyMask = 0;
+         p->Next = gWbHash[Hash];
+         gWbHash[Hash] = i;
+         gWbDirtyBlocks++;
+      }
+      memcpy(p->pData + Slot * CPM_SECTOR_SIZE,Data,CPM_SECTOR_SIZE);
+      p->DirtyMask |= 1 << Slot;
+
+      if((pResident = ResidentLookup(fp)) != NULL) {
+         memcpy(pResident + Pos,Data,CPM_SECTOR_SIZE);
+      }
+      else if((pLine = CacheLookup(fp,Pos)) != NULL) {
+         memcpy(pLine->pData + (Pos - pLine->Pos),Data,CPM_SECTOR_SIZE);
+      }
+   } while(false);
+
+   return Ret;
+}
+
+bool CacheDirty()
+{
+   return gWbDirtyBlocks != 0;
+}
+
+// Returns the number of dirty blocks of an image
+int CacheDirtyBlocks(FIL *fp)
+{
+   int Dirty = 0;
+   int i;
+
+   if(fp != NULL && gWbDirtyBlocks != 0) {
+      for(i = 0; i < WB_BLOCKS; i++) {
+         if(gWbBlocks[i].fp == fp) {
+            Dirty++;
+         }
+      }
+   }
+   return Dirty;
+}
+
+static bool FlushOrderLess(WbBlock *p1,WbBlock *p2)
+{
+   if(p1->fp != p2->fp) {
+      return (uint32_t) p1->fp < (uint32_t) p2->fp;
+   }
+   return p1->Block < p2->Block;
+}
+
+// Fill in the clean sectors of a partially dirty block
+static int WbFillBlock(WbBlock *p,uint8_t *pTo)
+{
+   FSIZE_t Pos = p->Block * WB_BLOCK_SIZE;
+   CacheLine *pLine = CacheLookup(p->fp,Pos);
+   uint8_t *pResident = ResidentLookup(p->fp);
+   int Slot;
+   int Ret = 0;
+
+   if(pResident != NULL) {
+      memcpy(pTo,pResident + Pos,WB_BLOCK_SIZE);
+   }
+   else if(pLine != NULL && Pos + WB_BLOCK_SIZE <= pLine->Pos + pLine->Len) {
+      memcpy(pTo,pLine->pData + (Pos - pLine->Pos),WB_BLOCK_SIZE);
+   }
+   else {
+      Ret = ImageRead(p->fp,Pos,pTo,WB_BLOCK_SIZE);
+   }
+
+   for(Slot = 0; Slot < WB_SLOTS; Slot++) {
+      if(p->DirtyMask & (1 << Slot)) {
+         memcpy(pTo + Slot * CPM_SECTOR_SIZE,p->pData + Slot * CPM_SECTOR_SIZE,
+                CPM_SECTOR_SIZE);
+      }
+   }
+   return Ret;
+}
+
+// Fill gFlushList with the dirty blocks of an image (all images if fp is
+// NULL) sorted by image and block.  Returns the number of blocks.
+static int WbGather(FIL *fp)
+{
+   int Dirty = 0;
+   int Gap;
+   int i;
+   int j;
+   int16_t Temp;
+
+   for(i = 0; i < WB_BLOCKS; i++) {
+      if(gWbBlocks[i].fp != NULL && (fp == NULL || gWbBlocks[i].fp == fp)) {
+         gFlushList[Dirty++] = i;
+      }
+   }
+
+// Shell sort by image and block
+   for(Gap = Dirty / 2; Gap > 0; Gap /= 2) {
+      for(i = Gap; i < Dirty; i++) {
+         Temp = gFlushList[i];
+         for(j = i; j >= Gap && 
+             FlushOrderLess(&gWbBlocks[Temp],&gWbBlocks[gFlushList[j - Gap]]);
+             j -= Gap)
+         {
+            gFlushList[j] = gFlushList[j - Gap];
+         }
+         gFlushList[j] = Temp;
+      }
+   }
+   return Dirty;
+}
+
+// Write the run of blocks starting at gFlushList[First].  The run ends at 
+// a gap in the image's blocks or LBAs, at an erase block boundary, at 
+// gFlushList[Last] or after MaxBlocks blocks.  Returns the number of 
+// blocks in the run, *pErr is set on error.  The run is only written if 
+// every block could be filled, the caller must leave the blocks of a 
+// failed run dirty so a later flush retries them.
+static int WbWriteRun(int First,int Last,int MaxBlocks,int *pErr)
+{
+   WbBlock *p = &gWbBlocks[gFlushList[First]];
+   FIL *RunFp = p->fp;
+   uint32_t RunBlock = p->Block;
+   uint32_t RunLba = ImageLba(RunFp,RunBlock);
+   uint32_t Lba;
+   int RunLen = 0;
+   int Err = 0;
+
+   for( ; ; ) {
+      if(p->DirtyMask == WB_ALL_DIRTY) {
+         memcpy(&gFlushBuf[RunLen * WB_BLOCK_SIZE],p->pData,WB_BLOCK_SIZE);
+      }
+      else if(WbFillBlock(p,&gFlushBuf[RunLen * WB_BLOCK_SIZE]) != 0) {
+         Err = 1;
+      }
+      RunLen++;
+      if(RunLen == MaxBlocks || First + RunLen == Last) {
+         break;
+      }
+      p = &gWbBlocks[gFlushList[First + RunLen]];
+      if(p->fp != RunFp || p->Block != RunBlock + RunLen) {
+         break;
+      }
+      Lba = ImageLba(p->fp,p->Block);
+      if(Lba != RunLba + RunLen || (Lba % ERASE_BLOCK_BLOCKS) == 0) {
+         break;
+      }
+   }
+
+   if(Err) {
+      ELOG("Couldn't fill block %d, run not written\n",RunBlock);
+   }
+   else {
+      VLOG("Writing %d blocks @ LBA %d\n",RunLen,RunLba);
+      Err = ImageWrite(RunFp,RunBlock * WB_BLOCK_SIZE,gFlushBuf,
+                       RunLen * WB_BLOCK_SIZE);
+   }
+   if(Err) {
+      *pErr = 1;
+   }
+   return RunLen;
+}
+
+// Return a written block to the free list
+static void WbRelease(int16_t Index)
+{
+   WbBlock *p = &gWbBlocks[Index];
+   int16_t *pLink = &gWbHash[WbHash(p->fp,p->Block)];
+
+   while(*pLink != Index) {
+      pLink = &gWbBlocks[*pLink].Next;
+   }
+   *pLink = p->Next;
+   p->fp = NULL;
+   p->Next = gWbFree;
+   gWbFree = Index;
+   gWbDirtyBlocks--;
+}
+
+// Write all dirty blocks to the images.  Returns 0 on success, blocks that
+// couldn't be written stay dirty.
+int CacheFlush()
+{
+   int Dirty;
+   int RunLen;
+   int RunErr;
+   int i;
+   int j;
+   FIL *RunFp;
+   FIL *LastFp = NULL;
+   int Ret = 0;
+
+// Any incremental flush in progress is superseded
+   gSliceFp = NULL;
+   if(gWbDirtyBlocks == 0) {
+      return 0;
+   }
+   LOG("Flushing %d blocks\n",gWbDirtyBlocks);
+   leds = LED_GREEN;
+
+   Dirty = WbGather(NULL);
+   for(i = 0; i < Dirty; i += RunLen) {
+      RunFp = gWbBlocks[gFlushList[i]].fp;
+      if(RunFp != LastFp) {
+         SparseMapPreFlush(RunFp);
+         LastFp = RunFp;
+      }
+      RunErr = 0;
+      RunLen = WbWriteRun(i,Dirty,ERASE_BLOCK_BLOCKS,&RunErr);
+      if(RunErr) {
+         Ret = 1;
+      }
+      if(i + RunLen == Dirty || gWbBlocks[gFlushList[i + RunLen]].fp != RunFp) {
+         if(ImageSync(RunFp) != 0) {
+            Ret = 1;
+         }
+         SparseMapSynced(RunFp);
+      }
+   // Return the written blocks to the free list
+      if(!RunErr) {
+         for(j = i; j < i + RunLen; j++) {
+            WbRelease(gFlushList[j]);
+         }
+      }
+   }
+   leds = 0;
+
+   return Ret;
+}
+
+// Start an incremental flush of an image's dirty blocks.  Blocks written 
+// to the image after this call are left for the next flush.
+void CacheFlushStart(FIL *fp)
+{
+   gSliceFp = fp;
+   gSliceCount = WbGather(fp);
+   gSlicePos = 0;
+   gSliceErr = false;
+   VLOG("Incremental flush of %d blocks\n",gSliceCount);
+   SparseMapPreFlush(fp);
+}
+
+// Write the next run of at most MaxBlocks blocks of the incremental flush.
+// Returns the number of blocks still to be written, 0 once the flush is 
+// complete and the image has been synced, or -1 once it is complete if any
+// run failed.  The blocks of a failed run stay dirty for the next flush.
+int CacheFlushSlice(int MaxBlocks)
+{
+   int RunLen;
+   int Err = 0;
+   int i;
+
+   if(gSliceFp == NULL) {
+      return 0;
+   }
+
+   if(gSlicePos < gSliceCount) {
+      leds = LED_GREEN;
+      RunLen = WbWriteRun(gSlicePos,gSliceCount,MaxBlocks,&Err);
+      for(i = 0; i < RunLen; i++) {
+         if(!Err) {
+            WbRelease(gFlushList[gSlicePos]);
+         }
+         gSlicePos++;
+      }
+      leds = 0;
+   }
+
+   if(gSlicePos == gSliceCount) {
+      if(ImageSync(gSliceFp) != 0) {
+         Err = 1;
+      }
+      SparseMapSynced(gSliceFp);
+      gSliceFp = NULL;
+   }
+   if(Err) {
+      gSliceErr = true;
+   }
+
+   if(gSlicePos < gSliceCount) {
+      return gSliceCount - gSlicePos;
+   }
+   return gSliceErr ? -1 : 0;
+}
+
+// Discard all cached lines for an image
+void CacheInvalidate(FIL *fp)
+{
+   int i;
+
+   for(i = 0; i < CACHE_LINES; i++) {
+      if(gLines[i].fp == fp) {
+         gLines[i].fp = NULL;
+      }
+   }
+   gLastHit = NULL;
+}
+
+void CacheDumpStats()
+{
+   int i;
+   CacheStats *p = gCacheStats;
+
+   ALOG_R("Disk cache statistics:\n");
+   for(i = 0; i < MAX_LOGICAL_DRIVES; i++, p++) {
+      if(p->ReadHits != 0 || p->ReadMisses != 0 || p->Writes != 0) {
+         ALOG_R("%c: read hits %d, misses %d, blank %d, writes %d, "
+                "write hits %d\n",'A' + i,p->ReadHits,p->ReadMisses,
+                p->BlankReads,p->Writes,p->WriteHits);
+      }
+   }
+   ALOG_R("Reads completed by the FPGA sector cache: %d\n",z80_sc_tag);
+}
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 3
+ * End:
+ */
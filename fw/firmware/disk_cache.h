@@ -0,0 +1,72 @@
+/*
+ *  disk_cache.h
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#ifndef _DISK_CACHE_H_
+#define _DISK_CACHE_H_
+
+#include "ff.h"
+#include "cpm_io.h"
+
+// Tracks with more sectors than this (512 MB z80pack HD) are cached in 
+// segments of CACHE_LINE_SECTORS sectors
+#define CACHE_LINE_SECTORS    128
+#define CACHE_LINE_SIZE       (CACHE_LINE_SECTORS * CPM_SECTOR_SIZE)
+// Room for the partial blocks on either end of tracks which aren't block
+// aligned
+#define CACHE_LINE_BUF_SIZE   (CACHE_LINE_SIZE + 2 * WB_BLOCK_SIZE)
+#define CACHE_LINES           64    // 1 MB of LPDDR
+
+// Write back cache
+#define WB_BLOCK_SIZE         FF_MAX_SS
+#define WB_SLOTS              (WB_BLOCK_SIZE / CPM_SECTOR_SIZE)
+#define WB_ALL_DIRTY          ((1 << WB_SLOTS) - 1)
+#define WB_BLOCKS             2048  // 1 MB of LPDDR
+#define WB_HASH_SIZE          512   // must be a power of 2
+// Flash erase block size.  Dirty blocks are flushed in runs which never 
+// cross an erase block boundary so each write lands in a single erase block
+#define ERASE_BLOCK_SIZE      (128 * 1024)
+#define ERASE_BLOCK_BLOCKS    (ERASE_BLOCK_SIZE / WB_BLOCK_SIZE)
+// LPDDR left free when loading resident images.  They're loaded after 
+// everything else has been allocated, this is just a margin.
+#define RESIDENT_RESERVE      (256 * 1024)
+
+typedef struct {
+   uint32_t ReadHits;
+   uint32_t ReadMisses;
+   uint32_t BlankReads;    // misses filled from the sparse map
+   uint32_t Writes;
+   uint32_t WriteHits;     // write to a block that was already dirty
+} CacheStats;
+
+extern CacheStats gCacheStats[MAX_LOGICAL_DRIVES];
+
+int DiskCacheInit(void);
+uint8_t *CacheRead(int Drive,FIL *fp,FSIZE_t LinePos,uint32_t LineLen,
+                   uint32_t Offset);
+int CacheWrite(int Drive,FIL *fp,FSIZE_t Pos,const uint8_t *Data);
+int CacheFlush(void);
+int CacheLoadImage(FIL *fp);
+void CacheFlushStart(FIL *fp);
+int CacheFlushSlice(int MaxBlocks);
+bool CacheDirty(void);
+int CacheDirtyBlocks(FIL *fp);
+void CacheInvalidate(FIL *fp);
+void CacheDumpStats(void);
+
+#endif   // _DISK_CACHE_H_
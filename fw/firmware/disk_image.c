@@ -0,0 +1,325 @@
+/*
+ *  disk_image.c
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Block level access to mounted disk images.
+ *
+ * Disk images are fixed size and never grow so when an image is mounted
+ * its cluster chain is resolved into a table of extents (runs of 
+ * contiguous clusters) using FatFs's fast seek cluster link map.  After
+ * that image blocks are translated directly into LBAs and read or written
+ * with disk_read/disk_write without touching the FAT, the directory entry
+ * or the FIL's sector buffer.
+ *
+ * If an image couldn't be mapped the FatFs file API is used instead.
+ * Either way the image's FIL has a cluster link map table so any f_lseek
+ * that is still needed doesn't walk the FAT.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "string.h"
+
+#include "ff.h"
+#include "diskio.h"
+#include "cpm_io.h"
+#include "disk_image.h"
+#include "ddr_mem.h"
+
+// #define DEBUG_LOGGING
+// #define LOG_TO_BOTH
+// #define VERBOSE_DEBUG_LOGGING
+#include "log.h"
+
+typedef struct {
+   uint32_t Block;   // first image block in the extent
+   uint32_t Lba;     // LBA of Block
+   uint32_t Count;   // blocks
+} Extent;
+
+typedef struct {
+   FIL *fp;
+   Extent *pExtents;
+   int NumExtents;
+   Extent *pLast;    // last extent used
+} ImageExtents;
+
+// One per FpArray entry
+static ImageExtents gImages[MAX_MOUNTED_DRIVES + 1];
+
+static ImageExtents *ImageLookup(FIL *fp)
+{
+   int i;
+
+   for(i = 0; i < MAX_MOUNTED_DRIVES + 1; i++) {
+      if(gImages[i].fp == fp) {
+         return &gImages[i];
+      }
+   }
+   return NULL;
+}
+
+// Build the extent table for an image, returns 0 on success.
+//
+// FatFs's fast seek cluster link map table (CLMT) is created for the image 
+// first so f_lseek on the FIL no longer needs to follow the FAT chain.
+// The CLMT is a list of fragments so it's also used to build the extent 
+// table.
+int ImageMap(FIL *fp,const char *Filename)
+{
+   FATFS *fs = fp->obj.fs;
+   ImageExtents *p;
+   DWORD Probe[1] = {1};
+   DWORD *pClmt;
+   DWORD TableSize;
+   Extent *pExtent;
+   uint32_t Block = 0;
+   int Fragments;
+   FRESULT Err;
+   int Ret = 1;
+
+   do {
+      if((p = ImageLookup(fp)) == NULL && (p = ImageLookup(NULL)) == NULL) {
+         ELOG("Internal error\n");
+         break;
+      }
+      p->fp = NULL;
+
+   // Find the required table size
+      fp->cltbl = Probe;
+      Err = f_lseek(fp,CREATE_LINKMAP);
+      fp->cltbl = NULL;
+      if(Err != FR_NOT_ENOUGH_CORE) {
+         ELOG("f_lseek failed: %d\n",Err);
+         break;
+      }
+      TableSize = Probe[0];
+      Fragments = (TableSize - 2) / 2;
+      if(Fragments <= 0) {
+         ELOG("%s is empty\n",Filename);
+         break;
+      }
+      if((pClmt = DdrAlloc(TableSize * sizeof(DWORD))) == NULL) {
+         break;
+      }
+      pClmt[0] = TableSize;
+      fp->cltbl = pClmt;
+      if((Err = f_lseek(fp,CREATE_LINKMAP)) != FR_OK) {
+         ELOG("f_lseek failed: %d\n",Err);
+         fp->cltbl = NULL;
+         break;
+      }
+      ALOG_R("%s: %d fragment%s\n",Filename,Fragments,
+             Fragments == 1 ? "" : "s");
+
+      if((p->pExtents = DdrAlloc(Fragments * sizeof(Extent))) == NULL) {
+         break;
+      }
+   // CLMT entries are pairs of fragment length and starting cluster
+      pExtent = p->pExtents;
+      for(pClmt++; pClmt[0] != 0; pClmt += 2) {
+         pExtent->Block = Block;
+         pExtent->Lba = fs->database + (pClmt[1] - 2) * fs->csize;
+         pExtent->Count = pClmt[0] * fs->csize;
+         Block += pExtent->Count;
+         pExtent++;
+      }
+      p->NumExtents = Fragments;
+      p->pLast = p->pExtents;
+      p->fp = fp;
+      Ret = 0;
+   } while(false);
+
+   if(Ret != 0) {
+      ELOG("Couldn't map %s, using FatFs\n",Filename);
+   }
+
+   return Ret;
+}
+
+static Extent *ImageFindExtent(ImageExtents *p,uint32_t Block)
+{
+   Extent *pExtent = p->pLast;
+   int i;
+
+   if(Block < pExtent->Block || Block >= pExtent->Block + pExtent->Count) {
+      pExtent = NULL;
+      for(i = 0; i < p->NumExtents; i++) {
+         if(Block >= p->pExtents[i].Block && 
+            Block < p->pExtents[i].Block + p->pExtents[i].Count)
+         {
+            pExtent = &p->pExtents[i];
+            p->pLast = pExtent;
+            break;
+         }
+      }
+   }
+   return pExtent;
+}
+
+// Return the LBA of an image block
+uint32_t ImageLba(FIL *fp,uint32_t Block)
+{
+   ImageExtents *p = ImageLookup(fp);
+   Extent *pExtent;
+
+   if(p != NULL && (pExtent = ImageFindExtent(p,Block)) != NULL) {
+      return pExtent->Lba + Block - pExtent->Block;
+   }
+   return Block;
+}
+
+// Read or write whole blocks using the extent table
+static int ImageXfer(ImageExtents *p,uint32_t Block,uint8_t *pData,
+                     uint32_t Blocks,bool bWrite)
+{
+   Extent *pExtent;
+   uint32_t Count;
+   DRESULT Err;
+   BYTE pdrv = p->fp->obj.fs->pdrv;
+   int Ret = 0;
+
+   while(Blocks > 0) {
+      if((pExtent = ImageFindExtent(p,Block)) == NULL) {
+         ELOG("Block %d is not in image\n",Block);
+         Ret = 1;
+         break;
+      }
+      Count = pExtent->Block + pExtent->Count - Block;
+      if(Count > Blocks) {
+         Count = Blocks;
+      }
+      VLOG("%s %d blocks @ LBA %d\n",bWrite ? "Writing" : "Reading",Count,
+           pExtent->Lba + Block - pExtent->Block);
+      if(bWrite) {
+         Err = disk_write(pdrv,pData,pExtent->Lba + Block - pExtent->Block,
+                          Count);
+      }
+      else {
+         Err = disk_read(pdrv,pData,pExtent->Lba + Block - pExtent->Block,
+                         Count);
+      }
+      if(Err != RES_OK) {
+         ELOG("disk_%s failed: %d\n",bWrite ? "write" : "read",Err);
+         Ret = 1;
+         break;
+      }
+      Block += Count;
+      Blocks -= Count;
+      pData += Count * IMAGE_BLOCK_SIZE;
+   }
+
+   return Ret;
+}
+
+// Read Len bytes from Pos.  Both must be multiples of IMAGE_BLOCK_SIZE.  
+// Returns 0 on success.
+int ImageRead(FIL *fp,FSIZE_t Pos,uint8_t *pData,uint32_t Len)
+{
+   ImageExtents *p = ImageLookup(fp);
+   FRESULT Err;
+   UINT Read;
+   int Ret = 1;
+
+   do {
+      if(p != NULL) {
+         Ret = ImageXfer(p,Pos / IMAGE_BLOCK_SIZE,pData,Len / IMAGE_BLOCK_SIZE,
+                         false);
+         break;
+      }
+      if((Err = f_lseek(fp,Pos)) != FR_OK) {
+         ELOG("f_lseek failed: %d\n",Err);
+         break;
+      }
+   // The last block of the image may be partial
+      if(Pos + Len > f_size(fp)) {
+         Len = f_size(fp) - Pos;
+      }
+      if((Err = f_read(fp,pData,Len,&Read)) != FR_OK) {
+         ELOG("f_read failed: %d\n",Err);
+         break;
+      }
+      if(Read != Len) {
+         ELOG("Short read failure, read %d, requested %d\n",Read,Len);
+         break;
+      }
+      Ret = 0;
+   } while(false);
+
+   return Ret;
+}
+
+// Write Len bytes to Pos.  Both must be multiples of IMAGE_BLOCK_SIZE.  
+// Returns 0 on success.
+int ImageWrite(FIL *fp,FSIZE_t Pos,const uint8_t *pData,uint32_t Len)
+{
+   ImageExtents *p = ImageLookup(fp);
+   FRESULT Err;
+   UINT Wrote;
+   int Ret = 1;
+
+   do {
+      if(p != NULL) {
+         Ret = ImageXfer(p,Pos / IMAGE_BLOCK_SIZE,(uint8_t *) pData,
+                         Len / IMAGE_BLOCK_SIZE,true);
+      // Invalidate the FIL's sector buffer, it may now be stale
+         fp->sect = 0;
+         break;
+      }
+      if((Err = f_lseek(fp,Pos)) != FR_OK) {
+         ELOG("f_lseek failed: %d\n",Err);
+         break;
+      }
+      if(Pos + Len > f_size(fp)) {
+         Len = f_size(fp) - Pos;
+      }
+      if((Err = f_write(fp,pData,Len,&Wrote)) != FR_OK) {
+         ELOG("f_write failed: %d\n",Err);
+         break;
+      }
+      if(Wrote != Len) {
+         ELOG("Short write failure, wrote %d, requested %d\n",Wrote,Len);
+         break;
+      }
+      Ret = 0;
+   } while(false);
+
+   return Ret;
+}
+
+// Only images accessed through FatFs need to be synced
+int ImageSync(FIL *fp)
+{
+   FRESULT Err;
+   int Ret = 0;
+
+   if(ImageLookup(fp) == NULL) {
+      if((Err = f_sync(fp)) != FR_OK) {
+         ELOG("f_sync failed: %d\n",Err);
+         Ret = 1;
+      }
+   }
+   return Ret;
+}
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 3
+ * End:
+ */
@@ -0,0 +1,33 @@
+/*
+ *  disk_image.h
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#ifndef _DISK_IMAGE_H_
+#define _DISK_IMAGE_H_
+
+#include "ff.h"
+
+#define IMAGE_BLOCK_SIZE      FF_MAX_SS
+
+int ImageMap(FIL *fp,const char *Filename);
+int ImageRead(FIL *fp,FSIZE_t Pos,uint8_t *pData,uint32_t Len);
+int ImageWrite(FIL *fp,FSIZE_t Pos,const uint8_t *pData,uint32_t Len);
+int ImageSync(FIL *fp);
+uint32_t ImageLba(FIL *fp,uint32_t Block);
+
+#endif   // _DISK_IMAGE_H_
@@ -0,0 +1,92 @@
+/*
+ *  dma.c
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Driver for the FPGA's DMA engine (fpga/dma_engine.v).
+ *
+ * The engine copies 32 bit words between any two addresses on the RISC V 
+ * bus (USB 32 bit window, LPDDR, packed Z80 RAM window, internal RAM) 
+ * sharing the bus with the CPU a transfer at a time.  The instruction 
+ * cache keeps DmaWait's polling loop off the bus most of the time.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "dma.h"
+
+// #define DEBUG_LOGGING
+// #define VERBOSE_DEBUG_LOGGING
+#include "log.h"
+
+void DmaStart(void *pTo,const void *pFrom,uint32_t Len)
+{
+   dma_src = (uint32_t) pFrom;
+   dma_dst = (uint32_t) pTo;
+   dma_len = (Len + 3) & ~3;
+   dma_ctrl = DMA_CTRL_START;
+}
+
+void DmaWait()
+{
+   while(dma_ctrl & DMA_STAT_BUSY);
+}
+
+static bool DmaSuitable(void *pTo,const void *pFrom,uint32_t Len)
+{
+   return Len >= DMA_MIN_LEN && (Len & 3) == 0 && 
+          DMA_ALIGNED(pTo) && DMA_ALIGNED(pFrom);
+}
+
+// Copy Len bytes with the DMA engine if the copy is suitable for it.
+// Returns false if the caller needs to do the copy itself.
+bool DmaCopy(void *pTo,const void *pFrom,uint32_t Len)
+{
+   bool bRet = false;
+
+   if(DmaSuitable(pTo,pFrom,Len)) {
+      DmaWait();
+      DmaStart(pTo,pFrom,Len);
+      DmaWait();
+      bRet = true;
+   }
+
+   return bRet;
+}
+
+// Start a copy like DmaCopy but return without waiting for it so the CPU
+// can do other work meanwhile, DmaWait() before the data is used.  Returns
+// false if the caller needs to do the copy itself.
+bool DmaCopyStart(void *pTo,const void *pFrom,uint32_t Len)
+{
+   bool bRet = false;
+
+   if(DmaSuitable(pTo,pFrom,Len)) {
+      DmaWait();
+      DmaStart(pTo,pFrom,Len);
+      bRet = true;
+   }
+
+   return bRet;
+}
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 3
+ * End:
+ */
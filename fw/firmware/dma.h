@@ -0,0 +1,52 @@
+/*
+ *  dma.h
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#ifndef _DMA_H_
+#define _DMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DMA_INTERFACE(x)   *((volatile uint32_t *)(0x03000300 + x ))
+#define dma_src            DMA_INTERFACE(0x00)
+#define dma_dst            DMA_INTERFACE(0x04)
+#define dma_len            DMA_INTERFACE(0x08)
+#define dma_ctrl           DMA_INTERFACE(0x0c)
+#define dma_desc           DMA_INTERFACE(0x10)
+
+// dma_ctrl writes
+#define DMA_CTRL_START     0x01
+#define DMA_CTRL_CHAIN     0x02
+#define DMA_CTRL_IRQ       0x04
+
+// dma_ctrl reads
+#define DMA_STAT_BUSY      0x01
+#define DMA_STAT_DONE      0x02
+
+// Transfers shorter than this are faster with the CPU
+#define DMA_MIN_LEN        32
+
+#define DMA_ALIGNED(x)     ((((uint32_t) (x)) & 3) == 0)
+
+void DmaStart(void *pTo,const void *pFrom,uint32_t Len);
+void DmaWait(void);
+bool DmaCopy(void *pTo,const void *pFrom,uint32_t Len);
+bool DmaCopyStart(void *pTo,const void *pFrom,uint32_t Len);
+
+#endif   // _DMA_H_
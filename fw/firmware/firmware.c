@@ -33,6 +33,10 @@
 #include "cpm_io.h"
 #include "vt100.h"
 #include "rtc.h"
+#include "disk_cache.h"
+#include "dma.h"
+#include "irq.h"
+#include "autorun.h"
 
 // #define LOG_TO_SERIAL
 // #define LOG_TO_BOTH
@@ -49,16 +53,64 @@ DWORD gBootImageLen;
 #define F_SCREEN_COLOR        6  // F6
 #define F_RESET_Z80           7  // F7
 #define F_VERBOSE_LOG_TOGGLE  8  // F8
+#define F_DISK_STATS          9  // F9
+
+#define IDLE_POLL_MS          10
+
 unsigned char gFunctionRequest;
 
 void LoadInitProg(void);
 void HandleFunctionKey(int Function);
 
-void irq_handler(uint32_t pc) 
+volatile uint32_t gIrqEvents;
+
+// Called from start.s with the interrupted PC and the pending interrupts.
+// Device interrupts are only noted here and left masked, the main loop
+// does the actual work and then unmasks them with IrqServiced().
+void irq_handler(uint32_t pc,uint32_t Irqs) 
 {
-   ELOG("HARD FAULT PC = 0x%08x\n",pc);
-   leds = LED_BLUE;  // "blue screen of death"
-   while(1);
+   if(Irqs & IRQ_BUS_ERROR) {
+      ELOG("HARD FAULT PC = 0x%08x\n",pc);
+      leds = LED_BLUE;  // "blue screen of death"
+      while(1);
+   }
+
+   if(Irqs & IRQ_DMA) {
+   // clear done, the DMA interrupt needs no further service
+      dma_ctrl = 0;
+      gIrqEvents |= IRQ_DMA;
+   }
+
+   if(Irqs & IRQ_USB) {
+      IrqDisable(IRQ_USB);
+      gIrqEvents |= IRQ_USB;
+   }
+
+   if(Irqs & IRQ_Z80_IO) {
+      IrqDisable(IRQ_Z80_IO);
+      gIrqEvents |= IRQ_Z80_IO;
+   }
+}
+
+// Service Z80 I/O traps back to back until the Z80 stops requesting them
+// then unmask the Z80 I/O interrupt again.  Queued console output is shown
+// first so it stays in order with the traps.
+static void Z80IoDispatch()
+{
+   for( ; ; ) {
+      ConsoleOutPoll();
+      switch(z80_io_state & IO_STATE_MASK) {
+         case IO_STAT_WRITE:  // Z80 out
+            HandleIoOut(z80_io_adr,z80_out_data);
+            continue;
+
+         case IO_STAT_READ:   // z80 In
+            HandleIoIn(z80_io_adr);
+            continue;
+      }
+      break;
+   }
+   IrqServiced(IRQ_Z80_IO);
 }
 
 void main() 
@@ -70,16 +122,15 @@ void main()
    const char root[] = "USB:/";
    char directory[18] = "";
    char DriveSave;
-   uint8_t LastIoState = 0xff;
    uint32_t IoState;
-   uint32_t Timeout = 0;
+   uint32_t Start;
    bool bWasHalted = false;
    
    dly_tap = 0x03;
 
-   // Set interrupt mask to zero (enable all interrupts)
-   // This is a PicoRV32 custom instruction 
-   asm(".word 0x0600000b");
+   // The PicoRV32 comes out of reset with every interrupt masked.  Enable
+   // the device interrupts irq_handler knows how to service.
+   IrqSetMask(~(IRQ_BUS_ERROR | IRQ_DMA | IRQ_USB | IRQ_Z80_IO));
 
    vt100_init();
    ALOG_R("Pano Logic G1, Z80 @ 25 Mhz, PicoRV32 @ 25MHz\n");
@@ -131,10 +182,16 @@ void main()
       f_closedir(&Dir);
    } while(false);
 
+   DiskCacheInit();
+   AutorunReserve();
    MountCpmDrives();
    LoadInitProg();
-   z80_con_status = 0;  // No console input yet
+   AutorunOpen();
 
+   DmaWait();
+// Drop anything seen while the Z80 was held in reset and make sure its I/O
+// interrupt is unmasked before it runs
+   IrqServiced(IRQ_Z80_IO);
    LOG("Releasing Z80 reset\n");
    z80_rst = 0;   // release Z80 reset
 
@@ -162,57 +219,43 @@ void main()
 
    for( ; ; ) {
       IdlePoll();
-      if(usb_kbd_testc()) {
-         z80_con_status = 0xff;  // console input ready
+      AutorunPoll();
+      AutorunLogPoll();
+      ConsoleInPoll();
+   // Normally drained by Z80IoDispatch, don't let output depend on that
+      ConsoleOutPoll();
+
+      IoState = z80_io_state;
+      if((IoState & IO_STAT_HALTED) && !bWasHalted) {
+         bWasHalted = true;
+         LOG("Z80 HALTED\n");
+         DisplayString("Z80 HALTED",29,0);
+      }
+      else if((IoState & IO_STAT_HALTED) == 0 && bWasHalted) {
+         bWasHalted = false;
+         DisplayString("          ",29,0);
       }
 
+   // Service the Z80 until an interrupt needs attention, IdlePoll's timed
+   // work is checked at least every IDLE_POLL_MS.  There's no timer 
+   // interrupt to wake a waitirq for that work so this loop still polls.
+      Start = ticks();
       do {
-         IoState = z80_io_state;
-
-         if(LastIoState != IoState) {
-            LastIoState = IoState;
-            VLOG("z80_io_state: %d\n",IoState);
-            if((IoState & IO_STAT_HALTED) && !bWasHalted) {
-               bWasHalted = true;
-               LOG("Z80 HALTED\n");
-               DisplayString("Z80 HALTED",29,0);
-            }
-            else if((IoState & IO_STAT_HALTED) == 0 && bWasHalted) {
-               bWasHalted = false;
-               DisplayString("          ",29,0);
-            }
-         }
-         
-         switch((IoState & IO_STATE_MASK)) {
-            case IO_STAT_WRITE:  // Z80 out
-               HandleIoOut(z80_io_adr,z80_out_data);
-               if(Timeout == 0) {
-               // Give the z80 a chance to output another character before
-               // we break out of this loop and call usb_event_poll again...
-                  Timeout = ticks_ms() + 50;
-               }
-               break;
-
-            case IO_STAT_READ:   // z80 In
-               HandleIoIn(z80_io_adr);
-               break;
-
-            case IO_STAT_IDLE:
-            case IO_STAT_READY:
-               break;
-
-            default:
-               LOG("IoState 0x%x\n",IoState);
-               break;
+         if(gIrqEvents & IRQ_Z80_IO) {
+            Z80IoDispatch();
          }
-      } while(ticks_ms() < Timeout && gFunctionRequest == 0);
-      Timeout = 0;
+      } while(!(gIrqEvents & IRQ_USB) && gFunctionRequest == 0 && 
+              ticks() - Start < IDLE_POLL_MS * 1000 * CYCLE_PER_US);
 
       if(gZ80_ResetRequest) {
          gZ80_ResetRequest = 0;
          z80_rst = 1;
+      // Write any pending data before the boot sector is reloaded
+         FlushWriteCache();
          LoadInitProg();
          ALOG_R(ANSI_HOME ANSI_CLS "Resetting Z80\n");
+      // The restored boot image may still be on its way to Z80 RAM
+         DmaWait();
          z80_rst = 0;
       }
    }
@@ -264,15 +307,28 @@ void HandleFunctionKey(int Function)
          break;
 
       case F_VERBOSE_LOG_TOGGLE:
-         LOG("z80_io_state: %d, z80_io_adr: %d\n",z80_io_state,z80_io_adr);
+         LOG("z80_io_state: %d, z80_io_adr: 0x%x\n",z80_io_state,
+             z80_io_adr & 0xff);
+      // Worst case since the last F8 in 32 clock units, the counter 
+      // saturates at 65535
+         LOG("Max Z80 I/O trap latency: %d clocks, %d us\n",
+             z80_trap_latency * 32,
+             z80_trap_latency * 32 / CYCLE_PER_US);
+         z80_trap_latency = 0;
+         break;
+
+      case F_DISK_STATS:
+         CacheDumpStats();
+         usb_stor_dump_stats();
          break;
    }
 }
 
 void LoadInitProg()
 {
-   bool BootImageLoaded = false;
-   if(gBootImageLen > 0) {
+   bool BootImageLoaded = RestoreBootImage();
+
+   if(!BootImageLoaded && gBootImageLen > 0) {
       LOG("Calling LoadImage\n");
       if(LoadImage(INIT_IMAGE_FILENAME,gBootImageLen) == 0) {
          BootImageLoaded = true;
@@ -289,10 +345,7 @@ void IdlePoll()
 {
    rtc_poll();
    usb_event_poll();
-   if(gWriteFlushTimeout != 0 && ticks_ms() >= gWriteFlushTimeout) {
-      gWriteFlushTimeout = 0;
-      FlushWriteCache();
-   }
+   FlushPoll();
    if(gFunctionRequest != 0) {
       HandleFunctionKey(gFunctionRequest);
       gFunctionRequest = 0;
@@ -0,0 +1,58 @@
+/*
+ *  irq.h
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#ifndef _IRQ_H_
+#define _IRQ_H_
+
+#include <stdint.h>
+
+// PicoRV32 interrupts, see pano_top.v
+#define IRQ_BUS_ERROR      0x01
+#define IRQ_DMA            0x08
+#define IRQ_USB            0x10
+#define IRQ_Z80_IO         0x20
+
+// Interrupts which have happened but haven't been serviced yet.  Set by
+// irq_handler, cleared by IrqServiced()
+extern volatile uint32_t gIrqEvents;
+
+// Set the PicoRV32 interrupt mask, returns the previous mask.
+// (maskirq a0,a0 custom instruction)
+static inline uint32_t IrqSetMask(uint32_t Mask)
+{
+   register uint32_t a0 asm("a0") = Mask;
+   asm volatile(".word 0x0605050b" : "+r" (a0) : : "memory");
+   return a0;
+}
+
+static inline void IrqDisable(uint32_t Irqs)
+{
+   uint32_t Mask = IrqSetMask(~0);
+   IrqSetMask(Mask | Irqs);
+}
+
+// Clear the event for an interrupt left masked by irq_handler and unmask it
+static inline void IrqServiced(uint32_t Irqs)
+{
+   uint32_t Mask = IrqSetMask(~0);
+   gIrqEvents &= ~Irqs;
+   IrqSetMask(Mask & ~Irqs);
+}
+
+#endif   // _IRQ_H_
@@ -23,6 +23,8 @@
 #include "usb.h"
 #include "isp1760.h"
 #include "isp_roothub.h"
+#include "dma.h"
+#include "irq.h"
 #include "string.h"
 
 // #define DEBUG_LOGGING
@@ -34,10 +36,12 @@ extern uint8_t gDumpPtd;
 
 #undef USE_ROOT_HUB
 
-// #define ISP_IRQ_DRIVEN
-
 interrupt_transfer_t registered_transfers[MAX_REG_INT_TRANSFER_NUM];
 
+// ATL and INT lists are both active when an interrupt transfer is 
+// scheduled so buffer status writes must preserve the other list's bit
+static uint32_t isp_buffer_status;
+
 // Define the interrupts that the driver will handle
 #define ISP_INT_MASK  0x00000080
 
@@ -46,9 +50,7 @@ uint32_t isp_read_word(uint32_t address) {
 }
 
 uint32_t isp_read_dword(uint32_t address) {
-    uint32_t l = *((volatile uint32_t *)(ISP_BASE_ADDR | (address << 1)));
-    uint32_t h = *((volatile uint32_t *)(ISP_BASE_ADDR | (address << 1) | 0x4));
-    return ((h << 16) | (l & 0xFFFF));
+    return *((volatile uint32_t *)(ISP_BASE_ADDR32 | address));
 }
 
 void isp_write_word(uint32_t address, uint32_t data) {
@@ -56,8 +58,12 @@ void isp_write_word(uint32_t address, uint32_t data) {
 }
 
 void isp_write_dword(uint32_t address, uint32_t data) {  
-    *((volatile uint32_t *)(ISP_BASE_ADDR | (address << 1))) = data & 0xFFFF;
-    *((volatile uint32_t *)(ISP_BASE_ADDR | (address << 1) | 0x4)) = data >> 16;  
+    *((volatile uint32_t *)(ISP_BASE_ADDR32 | address)) = data;
+}
+
+static void isp_buffer_filled(uint32_t filled) {
+    isp_buffer_status |= filled;
+    isp_write_dword(ISP_BUFFER_STATUS, isp_buffer_status);
 }
 
 // Datasheet, page 17
@@ -70,21 +76,30 @@ uint32_t isp_addr_cpu_to_mem(uint32_t cpu_address) {
 }
 
 void isp_write_memory(uint32_t address, uint32_t *data, uint32_t length) {
+    volatile uint32_t *p;
+
     address = isp_addr_mem_to_cpu(address);
+    p = (volatile uint32_t *)(ISP_BASE_ADDR32 | address);
+    if (DmaCopy((void *)p, data, (length + 3) & ~3))
+        return;
     for (uint32_t i = 0; i < length; i+= 4) {
-        isp_write_dword(address, *data++);
-        address += 4;
+        *p++ = *data++;
     }
 }
 
 void isp_read_memory(uint32_t address, uint32_t *data, uint32_t length) {
+    volatile uint32_t *p;
+
     // TODO: What about bank address?
     // Doesn't seem to matter if read is not interleaved
     address = isp_addr_mem_to_cpu(address);
     isp_write_dword(ISP_MEMORY, address);
+    // Sequential reads are served from the bridge's prefetch buffer
+    p = (volatile uint32_t *)(ISP_BASE_ADDR32 | address);
+    if (DmaCopy(data, (void *)p, (length + 3) & ~3))
+        return;
     for (uint32_t i = 0; i < length; i+= 4) {
-        *data++ = isp_read_dword(address);
-        address += 4;
+        *data++ = *p++;
     }
 }
 
@@ -130,6 +145,7 @@ int isp_init()
     } 
     
     // Disable all buffers
+    isp_buffer_status = 0;
     isp_write_dword(ISP_BUFFER_STATUS, 0x00000000);
 
     // Skip all transfers
@@ -268,7 +284,8 @@ isp_result_t isp_transfer(ptd_type_t ptd_type, usb_speed_t speed,
     int NakCount = 0;
     int NakTimeout = Timeout != 0 ? Timeout : NACK_TIMEOUT_MS;
 
-    payload_address = MEM_PAYLOAD_BASE;
+    payload_address = 
+        (ptd_type == TYPE_INT) ? MEM_INT_PAYLOAD_BASE : MEM_PAYLOAD_BASE;
 
     //if (max_packet_length > 64) max_packet_length = 64;
 
@@ -331,13 +348,7 @@ isp_result_t isp_transfer(ptd_type_t ptd_type, usb_speed_t speed,
             isp_write_dword(reg_ptd_lastptd, 0x00000001);
 
             // Indicate ATL PTD is filled, start process
-            isp_write_dword(ISP_BUFFER_STATUS, buffer_status_filled);
-
-            #ifdef ISP_IRQ_DRIVEN
-            // If the transfer is a interrupt transfer, stop here.
-            if (ep_type == EP_INTERRUPT) 
-                return 0;
-            #endif
+            isp_buffer_filled(buffer_status_filled);
         }
         
         // Wait for the setup to be completed
@@ -402,7 +413,7 @@ isp_result_t isp_transfer(ptd_type_t ptd_type, usb_speed_t speed,
     // If current direction is input, read payload back
     if (direction == DIRECTION_IN) {
         if (result == ISP_SUCCESS) {
-            *length = actual_transfer_length & 0x0FFF;
+            *length = actual_transfer_length & 0x7FFF;
             if ((actual_transfer_length != 0) && 
                     (actual_transfer_length <= max_length)) {
                 isp_read_memory(payload_address, (uint32_t *)buffer, 
@@ -422,6 +433,190 @@ isp_result_t isp_transfer(ptd_type_t ptd_type, usb_speed_t speed,
     return result;
 }
 
+// Start an ATL bulk PTD in the given pipelined transfer slot
+static void isp_pp_arm(uint32_t slot, usb_speed_t speed, usb_token_t token,
+        uint32_t device_address, uint32_t parent_port, 
+        uint32_t parent_address, uint32_t toggle, uint32_t ep,
+        uint32_t payload_address, uint32_t length, 
+        uint32_t max_packet_length)
+{
+    uint32_t ptd[PTD_SIZE_DWORD];
+
+    isp_build_header(speed, token, device_address, parent_port, 
+            parent_address, toggle, EP_BULK, ep, ptd, payload_address, 
+            length, max_packet_length);
+    isp_write_memory(MEM_ATL_BASE + slot * (PTD_SIZE_BYTE >> 3), ptd, 
+            PTD_SIZE_BYTE);
+    isp_write_dword(ISP_ATL_PTD_SKIPMAP, ~(1u << slot));
+    isp_buffer_filled(ISP_BUFFER_STATUS_ATL_FILLED);
+}
+
+// Bulk transfer larger than one payload buffer.
+// The transfer is split into ISP_PP_BUF_SIZE chunks which alternate 
+// between two PTD slots, each with its own payload buffer.  Only one PTD
+// is active at a time since the controller is free to interleave PTDs 
+// for the same endpoint, but the next chunk is started as soon as the 
+// previous one completes so the CPU copies one buffer while the 
+// controller fills (or drains) the other.
+static isp_result_t isp_bulk_pipelined(usb_speed_t speed, 
+        transfer_direction_t direction, uint32_t device_address, 
+        uint32_t parent_port, uint32_t parent_address, 
+        uint32_t max_packet_length, uint32_t *toggle, uint32_t ep, 
+        uint8_t *buffer, uint32_t *length, int Timeout)
+{
+    isp_result_t result = ISP_SUCCESS;
+    usb_token_t token = (direction == DIRECTION_IN) ? TOKEN_IN : TOKEN_OUT;
+    uint32_t total = *length;
+    uint32_t chunk_off[ISP_PP_SLOTS];  // offset of chunk in buffer
+    uint32_t chunk_len[ISP_PP_SLOTS];  // length of chunk
+    uint32_t chunk_done[ISP_PP_SLOTS]; // bytes of chunk already moved
+    uint32_t payload[ISP_PP_SLOTS];
+    uint32_t next_off;                 // offset of next chunk to start
+    uint32_t completed = 0;
+    uint32_t slot = 0;
+    uint32_t other;
+    uint32_t donemap = 0;
+    uint32_t readback_ptd[4];
+    uint32_t dw3;
+    uint32_t xferred;
+    uint32_t start_ticks = ticks_ms();
+    int NakTimeout = Timeout != 0 ? Timeout : NACK_TIMEOUT_MS;
+    int NakCount = 0;
+    bool short_packet = false;
+
+    for (other = 0; other < ISP_PP_SLOTS; other++) {
+        payload[other] = MEM_PAYLOAD_BASE + other * (ISP_PP_BUF_SIZE >> 3);
+    }
+
+    isp_write_dword(ISP_ATL_PTD_SKIPMAP, 0xffffffff);
+    isp_write_dword(ISP_ATL_PTD_LASTPTD, 1u << (ISP_PP_SLOTS - 1));
+
+    // Start the first chunk and for OUT transfers preload the second
+    chunk_off[0] = 0;
+    chunk_len[0] = total > ISP_PP_BUF_SIZE ? ISP_PP_BUF_SIZE : total;
+    chunk_done[0] = 0;
+    next_off = chunk_len[0];
+    if (direction == DIRECTION_OUT) {
+        isp_write_memory(payload[0], (uint32_t *)buffer, chunk_len[0]);
+    }
+    isp_pp_arm(0, speed, token, device_address, parent_port, parent_address,
+            *toggle, ep, payload[0], chunk_len[0], max_packet_length);
+    if (direction == DIRECTION_OUT && next_off < total) {
+        xferred = total - next_off;
+        if (xferred > ISP_PP_BUF_SIZE)
+            xferred = ISP_PP_BUF_SIZE;
+        isp_write_memory(payload[1], (uint32_t *)(buffer + next_off), 
+                xferred);
+    }
+
+    for ( ; ; ) {
+        // Wait for the active PTD, reading the donemap clears it
+        while (!(donemap & (1u << slot))) {
+            donemap |= isp_read_dword(ISP_ATL_PTD_DONEMAP);
+            if (!(donemap & (1u << slot)) && 
+                (ticks_ms() - start_ticks) > NakTimeout + SETUP_TIMEOUT_MS) {
+                result = ISP_SETUP_TIMEOUT;
+                break;
+            }
+        }
+        if (result != ISP_SUCCESS) 
+            break;
+        donemap &= ~(1u << slot);
+
+        isp_read_memory(MEM_ATL_BASE + slot * (PTD_SIZE_BYTE >> 3), 
+                readback_ptd, sizeof(readback_ptd));
+        dw3 = readback_ptd[3];
+        xferred = dw3 & 0x7FFF;
+        *toggle = (dw3 >> 25) & 0x1;
+
+        if (dw3 & (1u << 30)) {
+            result = ISP_TRANSFER_HALT;
+            break;
+        }
+        else if (dw3 & (1u << 29)) {
+            result = ISP_BABBLE;
+            break;
+        }
+        else if (dw3 & (1u << 28)) {
+            result = ISP_TRANSFER_ERROR;
+            break;
+        }
+        chunk_done[slot] += xferred;
+
+        if (dw3 & (1u << 31)) {
+        // NAKed before the chunk completed, restart the rest of it
+            NakCount++;
+            if ((ticks_ms() - start_ticks) >= NakTimeout) {
+                result = ISP_NACK_TIMEOUT;
+                break;
+            }
+            start_ticks = ticks_ms();
+            isp_pp_arm(slot, speed, token, device_address, parent_port, 
+                    parent_address, *toggle, ep, 
+                    payload[slot] + (chunk_done[slot] >> 3),
+                    chunk_len[slot] - chunk_done[slot], max_packet_length);
+            continue;
+        }
+        start_ticks = ticks_ms();
+
+        if (chunk_done[slot] != chunk_len[slot]) {
+            if (direction == DIRECTION_OUT) {
+                result = ISP_WRONG_LENGTH;
+                break;
+            }
+            short_packet = true;
+        }
+
+        // Start the next chunk in the other slot before touching this
+        // slot's data
+        other = slot ^ 1;
+        if (!short_packet && next_off < total) {
+            chunk_off[other] = next_off;
+            chunk_len[other] = total - next_off;
+            if (chunk_len[other] > ISP_PP_BUF_SIZE)
+                chunk_len[other] = ISP_PP_BUF_SIZE;
+            chunk_done[other] = 0;
+            next_off += chunk_len[other];
+            isp_pp_arm(other, speed, token, device_address, parent_port, 
+                    parent_address, *toggle, ep, payload[other], 
+                    chunk_len[other], max_packet_length);
+        }
+        else {
+            other = slot;
+        }
+
+        if (direction == DIRECTION_IN) {
+            if (chunk_done[slot] != 0) {
+                isp_read_memory(payload[slot], 
+                        (uint32_t *)(buffer + chunk_off[slot]), 
+                        chunk_done[slot]);
+            }
+        }
+        else if (other != slot && next_off < total) {
+        // Preload the chunk after the one just started
+            xferred = total - next_off;
+            if (xferred > ISP_PP_BUF_SIZE)
+                xferred = ISP_PP_BUF_SIZE;
+            isp_write_memory(payload[slot], 
+                    (uint32_t *)(buffer + next_off), xferred);
+        }
+        completed += chunk_done[slot];
+
+        if (other == slot) 
+            break;   // all done
+        slot = other;
+    }
+
+    isp_write_dword(ISP_ATL_PTD_SKIPMAP, 0xffffffff);
+    *length = completed;
+
+    if (NakCount > 0) {
+        LOG_R(" %d NACKS\n",NakCount);
+    }
+
+    return result;
+}
+
 void isp_build_header(usb_speed_t speed, usb_token_t token, uint32_t device_address,
         uint32_t parent_port, uint32_t parent_address, uint32_t toggle,
         usb_ep_type_t ep_type, uint32_t ep, uint32_t *ptd, 
@@ -550,10 +745,20 @@ static int isp_submit(
       usb_token_t token = 
       (direction == DIRECTION_IN) ? (TOKEN_IN) : (TOKEN_OUT);
       new_toggle = toggle;
-      result = isp_transfer(ptd_type, speed, direction, token, address, 
-                            parent_port, parent_address, max_packet_length, &new_toggle, ep_type,
-                            ep, buffer, (uint32_t)length, (uint32_t *)&actual_length, true,
-                            Timeout);
+      if(ep_type == EP_BULK && speed == SPEED_HIGH && 
+         length > ISP_PP_BUF_SIZE) 
+      {
+         result = isp_bulk_pipelined(speed, direction, address, parent_port,
+                                     parent_address, max_packet_length, 
+                                     &new_toggle, ep, buffer, 
+                                     (uint32_t *)&actual_length, Timeout);
+      }
+      else {
+         result = isp_transfer(ptd_type, speed, direction, token, address, 
+                               parent_port, parent_address, max_packet_length, &new_toggle, ep_type,
+                               ep, buffer, (uint32_t)length, (uint32_t *)&actual_length, true,
+                               Timeout);
+      }
    }
 
    if(req != NULL && result == ISP_SUCCESS) {
@@ -842,121 +1047,175 @@ unknown:
 // Periodical interrupt transfer scheduling
 // -----------------------------------------------------------------------------
 
-void isp_register_transfer(struct usb_device *dev, unsigned long pipe, 
-        void *buffer, int transfer_len) {
-    // new transfer must come as scheduled
-    for (int i = 0; i < MAX_REG_INT_TRANSFER_NUM; i++) {
-        if (registered_transfers[i].device == NULL) {
-            registered_transfers[i].device = dev;
-            registered_transfers[i].pipe = pipe;
-            registered_transfers[i].buffer = buffer;
-            registered_transfers[i].length = transfer_len;
-            registered_transfers[i].state = STATE_SCHEDULED;
-            LOG("New interrupt transfer registered.\n");
-            break;
-        }
+// Each registered transfer owns INT PTD slot <id>.  The PTD is written 
+// once with the endpoint's polling interval and left for the ISP1760 to 
+// poll, NAKs are retried by the hardware at the next interval.  When a
+// report arrives the PTD's bit is set in the INT donemap, the report is
+// passed to the driver and the PTD is reactivated.
+
+static uint32_t isp_int_ptd_address(uint32_t id) {
+    return MEM_INT_BASE + id * (PTD_SIZE_BYTE >> 3);
+}
+
+// Set the polling interval of an INT PTD built by isp_build_header.
+// Periods are rounded down to a power of 2.
+static void isp_int_set_interval(uint32_t *ptd, usb_speed_t speed, 
+        int interval) {
+    uint32_t rate;      // polling period 2^(rate - 1) ms
+    uint32_t usof;      // microframes to poll in within a frame
+    uint32_t period;
+
+    if (interval < 1)
+        interval = 1;
+
+    if (speed == SPEED_HIGH) {
+        // bInterval is the exponent of the period in microframes
+        if (interval > 16)
+            interval = 16;
+        period = 1u << (interval - 1);
+        usof = (period >= 8) ? 0x01 : (period >= 4) ? 0x11 : 
+               (period >= 2) ? 0x55 : 0xff;
+        period = (period >= 8) ? (period >> 3) : 1;
     }
+    else {
+        // bInterval is the period in frames, the start split microframe
+        // mask set by isp_build_header is kept
+        period = interval;
+        usof = ptd[4] & 0xff;
+    }
+
+    rate = 1;
+    while (rate < 6 && (1u << rate) <= period)
+        rate++;
+
+    ptd[2] = (ptd[2] & ~0xff) | (rate << 3);
+    ptd[4] = (ptd[4] & ~0xff) | usof;
 }
 
-void isp_deregister_transfer(struct usb_device *device) {
+// (Re)activate the INT PTD of a registered transfer
+static void isp_int_arm(uint32_t id) {
+    interrupt_transfer_t *p = &registered_transfers[id];
+    struct usb_device *dev = p->device;
+    uint32_t ep = usb_pipeendpoint(p->pipe);
+    uint32_t toggle = usb_gettoggle(dev, ep, 0);
+    uint32_t address = isp_int_ptd_address(id);
+    uint32_t dw0 = p->ptd[0];
+
+    p->ptd[3] = (p->ptd[3] & ~(1u << 25)) | ((toggle & 0x1) << 25);
+    // Write the PTD with the valid bit clear, then set it
+    p->ptd[0] = dw0 & ~0x1;
+    isp_write_memory(address, p->ptd, PTD_SIZE_BYTE);
+    p->ptd[0] = dw0;
+    isp_write_memory(address, p->ptd, 4);
+    p->state = STATE_SCHEDULED;
+}
+
+static void isp_int_update_maps(void) {
+    uint32_t map = 0;
+    uint32_t last = 0;
+
     for (int i = 0; i < MAX_REG_INT_TRANSFER_NUM; i++) {
-        if (registered_transfers[i].device == device) {
-            registered_transfers[i].device = NULL;
-            break;
+        if (registered_transfers[i].device != NULL) {
+            map |= 1u << i;
+            last = 1u << i;
         }
     }
+    isp_write_dword(ISP_INT_IRQ_MASK_OR, map);
+    isp_write_dword(ISP_INT_PTD_LASTPTD, last);
+    isp_write_dword(ISP_INT_PTD_SKIPMAP, ~map);
+    if (map != 0)
+        isp_buffer_filled(ISP_BUFFER_STATUS_INT_FILLED);
 }
 
-isp_result_t isp_finish_trasnfer(uint32_t id) {
-    struct usb_device *dev = registered_transfers[id].device;
-    unsigned long pipe = registered_transfers[id].pipe;
-    uint32_t length = registered_transfers[id].length;
-    uint8_t *buffer = registered_transfers[id].buffer;
+int isp_register_transfer(struct usb_device *dev, unsigned long pipe, 
+        void *buffer, int transfer_len, int interval) {
     usb_speed_t speed = (usb_speed_t)usb_pipespeed(pipe);
     uint32_t ep = usb_pipeendpoint(pipe);
-    uint32_t max_packet_length = usb_maxpacket(dev, pipe);
-    uint32_t toggle = usb_gettoggle(dev, ep, usb_pipeout(pipe));
-    uint32_t address = usb_pipedevice(pipe);
     uint32_t parent_address = (dev->parent != NULL) ? dev->parent->devnum : 0;
-    uint32_t parent_port = dev->portnr;
-    usb_ep_type_t ep_type = EP_INTERRUPT;
-    ptd_type_t ptd_type = TYPE_INT;
-    transfer_direction_t direction = DIRECTION_IN;
-    usb_token_t token = TOKEN_IN;
-    
-    LOG("FI ");
-    return isp_transfer(ptd_type, speed, direction, token, address, 
-            parent_port, parent_address, max_packet_length, &toggle, ep_type,
-            ep, buffer, (uint32_t)length, (uint32_t *)&length, false,0);
-}
+    interrupt_transfer_t *p;
 
-void isp_callback_irq(void) {
     for (int i = 0; i < MAX_REG_INT_TRANSFER_NUM; i++) {
-        if (registered_transfers[i].device != NULL) {
-            if (registered_transfers[i].state == STATE_SCHEDULED) {
-                isp_result_t result = isp_finish_trasnfer(i);
-                if (result == ISP_SUCCESS)
-                    registered_transfers[i].device->irq_handle(
-                            registered_transfers[i].device);
-                registered_transfers[i].state = STATE_FINISHED;
-            }
+        p = &registered_transfers[i];
+        if (p->device == NULL) {
+            if (transfer_len > ISP_INT_PAYLOAD_SIZE)
+                transfer_len = ISP_INT_PAYLOAD_SIZE;
+            p->device = dev;
+            p->pipe = pipe;
+            p->buffer = buffer;
+            p->length = transfer_len;
+            isp_build_header(speed, TOKEN_IN, usb_pipedevice(pipe), 
+                    dev->portnr, parent_address, 0, EP_INTERRUPT, ep, p->ptd,
+                    MEM_INT_PAYLOAD_BASE + i * (ISP_INT_PAYLOAD_SIZE >> 3),
+                    transfer_len, usb_maxpacket(dev, pipe));
+            isp_int_set_interval(p->ptd, speed, interval);
+            isp_int_arm(i);
+            isp_int_update_maps();
+            LOG("New interrupt transfer registered, interval %d.\n",
+                interval);
+            return 0;
         }
     }
+    ELOG("No free interrupt transfer slots\n");
+    return -1;
 }
 
-void isp_schedule(uint32_t id) {
-    isp_submit(registered_transfers[id].device,
-            registered_transfers[id].pipe, 
-            registered_transfers[id].buffer, 
-            registered_transfers[id].length, NULL,0);
-    registered_transfers[id].state = STATE_SCHEDULED;
-}
-
-void isp_reschedule(void) {
-    // should only be called when no transfers are scheduled
+void isp_deregister_transfer(struct usb_device *device) {
     for (int i = 0; i < MAX_REG_INT_TRANSFER_NUM; i++) {
-        if (registered_transfers[i].device != NULL) {
-            if (registered_transfers[i].state == STATE_IDLE) {
-                // schedule this
-                isp_schedule(i);
-                return;
-            }
+        if (registered_transfers[i].device == device) {
+            registered_transfers[i].device = NULL;
+            registered_transfers[i].state = STATE_IDLE;
+            isp_int_update_maps();
+            break;
         }
     }
-    // finished but nothing has been scheduled, probably all transfers are done
-    int scheduled = false;
-    for (int i = 0; i < MAX_REG_INT_TRANSFER_NUM; i++) {
-        registered_transfers[i].state = STATE_IDLE;
-        if ((registered_transfers[i].device != NULL) && !scheduled) {
-            isp_schedule(i);
-            scheduled = 1;
-        }
+}
+
+// Pass a completed report to the driver and reactivate the PTD
+static void isp_int_complete(uint32_t id) {
+    interrupt_transfer_t *p = &registered_transfers[id];
+    struct usb_device *dev = p->device;
+    uint32_t readback_ptd[4];
+    uint32_t length;
+
+    isp_read_memory(isp_int_ptd_address(id), readback_ptd, 16);
+    if (readback_ptd[3] & ((1u << 30) | (1u << 29) | (1u << 28))) {
+        // Halt, babble or error, leave the PTD inactive
+        ELOG("INT transfer %d failed, DW3 0x%08x\n", id, readback_ptd[3]);
+        dev->irq_status = USB_ST_STALLED;
+        p->state = STATE_IDLE;
+        return;
     }
+
+    length = readback_ptd[3] & 0x7FFF;
+    if (length > p->length)
+        length = p->length;
+    if (length != 0)
+        isp_read_memory(MEM_INT_PAYLOAD_BASE + id * (ISP_INT_PAYLOAD_SIZE >> 3),
+                (uint32_t *)p->buffer, length);
+    usb_settoggle(dev, usb_pipeendpoint(p->pipe), 0, 
+            (readback_ptd[3] >> 25) & 0x1);
+    dev->irq_status = 0;
+    dev->act_len = length;
+    isp_int_arm(id);
+    if (dev->irq_handle != NULL)
+        dev->irq_handle(dev);
 }
 
 void isp_isr(void) {
     uint32_t interrupts;
+    uint32_t donemap;
+
     interrupts = isp_read_dword(ISP_INTERRUPT);
+    // Acknowledge before dispatching so completions which happen while
+    // the callbacks run raise a new interrupt
+    isp_write_dword(ISP_INTERRUPT, interrupts);
     if (interrupts & ISP_INTERRUPT_INT) {
-        // An interrupt transfer has completed.
-        // Call the callback
-        LOG("i");
-        isp_callback_irq();
-        isp_reschedule();
-    }
-}
-
-void isp_poll_no_irq(void) {
-    for (int i = 0; i < MAX_REG_INT_TRANSFER_NUM; i++) {
-        if (registered_transfers[i].device != NULL) {
-            // JUST POLL THIS
-            int result = isp_submit(registered_transfers[i].device,
-                    registered_transfers[i].pipe, 
-                    registered_transfers[i].buffer, 
-                    registered_transfers[i].length, NULL,0);
-            if (result == 0)
-                registered_transfers[i].device->irq_handle(
-                        registered_transfers[i].device);
+        // Reading the donemap clears it
+        donemap = isp_read_dword(ISP_INT_PTD_DONEMAP);
+        LOG("i %x", donemap);
+        for (int i = 0; i < MAX_REG_INT_TRANSFER_NUM; i++) {
+            if ((donemap & (1u << i)) && registered_transfers[i].device != NULL)
+                isp_int_complete(i);
         }
     }
 }
@@ -1040,27 +1299,16 @@ int submit_int_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
    }
     // interrupt messages usually have a callback function.
     // the callback need to be managed inside the driver
-    isp_register_transfer(dev, pipe, buffer, transfer_len);
-
-#ifdef ISP_IRQ_DRIVEN
-    // interval is not changeable
-    return isp_submit(dev, pipe, buffer, transfer_len, NULL);
-#else
-    return 0;
-#endif
+    return isp_register_transfer(dev, pipe, buffer, transfer_len, interval);
 }
 
 void usb_event_poll(void) {
-#ifdef ISP_IRQ_DRIVEN
-    // Check if there is any interrupts, if so, call the interrupt handler
-    // This is used when there is no hardware IRQs in the system
-    if ((isp_read_dword(ISP_INTERRUPT) & ISP_INT_MASK) != 0) {
+    // Nothing to do unless irq_handler has seen USB_IRQ, it leaves the 
+    // interrupt masked until the ISP1760 has been serviced
+    if (gIrqEvents & IRQ_USB) {
         isp_isr();
+        IrqServiced(IRQ_USB);
     }
-    isp_write_dword(ISP_INTERRUPT, ISP_INT_MASK); // Clear interrupts
-#else
-    isp_poll_no_irq();
-#endif
 }
 
 #endif
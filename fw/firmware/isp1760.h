@@ -20,6 +20,8 @@
 #define __ISP1760_H__
 
 #define ISP_BASE_ADDR 0x04000000
+// 32 bit accesses to dword aligned addresses, see usb_picorv_bridge.v
+#define ISP_BASE_ADDR32 0x04040000
 #define isp_reset_pin *((volatile uint32_t *)0x0300001c)
 
 #define ISP_CAPLENGTH            0x0000
@@ -99,6 +101,19 @@
 #define MEM_ATL_BASE             0x0100
 #define MEM_PAYLOAD_BASE         0x0180
 
+// Pipelined bulk transfers use PTD slots 0 and 1 with a payload buffer of
+// ISP_PP_BUF_SIZE bytes each starting at MEM_PAYLOAD_BASE.  Keep the
+// buffer size a multiple of 2 high speed max packets so the data toggle
+// is the same at the start of every buffer.
+#define ISP_PP_SLOTS             2
+#define ISP_PP_BUF_SIZE          (8 * 1024)
+
+// Interrupt transfer payloads live at the top of the memory out of the way
+// of the ATL transfers, ISP_INT_PAYLOAD_SIZE bytes for each registered
+// transfer
+#define MEM_INT_PAYLOAD_BASE     0x1F00
+#define ISP_INT_PAYLOAD_SIZE     64
+
 // ISP1760 internal memory address mapped in ISP1760 PIO interface address
 #define MEM_BASE                 0x0400
 
@@ -173,6 +188,7 @@ typedef struct interrupt_transfer {
     void *buffer;
     int length;
     transfer_state_t state;
+    uint32_t ptd[PTD_SIZE_DWORD];   // INT PTD as written to the ISP1760
 } interrupt_transfer_t;
 
 int isp_init();
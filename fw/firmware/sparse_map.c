@@ -0,0 +1,379 @@
+/*
+ *  sparse_map.c
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Occupancy map for large, mostly empty disk images.
+ *
+ * The image is divided into units (one track cache line) and the map
+ * records whether each unit is known to be blank, i.e. entirely 0xe5
+ * (formatted) or entirely zero (never written).  Track cache misses on a
+ * blank unit are filled in LPDDR without reading the image.
+ *
+ * The map is learned: a unit is marked blank when a track cache miss reads
+ * it from the image and finds it blank, and it is marked unknown again as
+ * soon as it is written.  The map is kept in a sidecar file with the same
+ * name as the image and a .MAP extension so it survives between sessions.
+ *
+ * Safety rules:
+ * - Before any data is written to an image, the sidecar is rewritten
+ *   if any unit has gone from blank to unknown since the last save.
+ *   After a crash the sidecar therefore never claims a written unit is blank.
+ * - The sidecar records the image's size and timestamp.  If the image has
+ *   been changed elsewhere the sidecar is ignored and the map is relearned.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "string.h"
+
+#include "ff.h"
+#include "misc.h"
+#include "cpm_io.h"
+#include "sparse_map.h"
+#include "ddr_mem.h"
+
+// #define DEBUG_LOGGING
+// #define LOG_TO_BOTH
+// #define VERBOSE_DEBUG_LOGGING
+#include "log.h"
+
+// Two bits per unit
+#define UNIT_UNKNOWN    0
+#define UNIT_E5         1
+#define UNIT_ZERO       2
+#define UNITS_PER_WORD  16
+
+typedef struct {
+   uint32_t Magic;
+   uint32_t ImageSize;
+   uint32_t UnitSize;
+   WORD fdate;          // image timestamp when the map was saved
+   WORD ftime;
+} SparseHeader;
+
+typedef struct {
+   FIL *fp;
+   char Filename[FF_SFN_BUF + 1];
+   SparseHeader *pHeader;  // followed by the map
+   uint32_t *pMap;
+   uint32_t Units;
+   uint32_t LastChange;    // ticks_ms() of the first unsaved change
+   bool bLearned;          // units have become blank since the last save
+   bool bCleared;          // units have become unknown since the last save
+} SparseMap;
+
+// One per FpArray entry
+static SparseMap gMaps[MAX_MOUNTED_DRIVES + 1];
+
+static SparseMap *SparseLookup(FIL *fp)
+{
+   int i;
+
+   for(i = 0; i < MAX_MOUNTED_DRIVES + 1; i++) {
+      if(gMaps[i].fp == fp) {
+         return &gMaps[i];
+      }
+   }
+   return NULL;
+}
+
+static uint32_t MapSize(SparseMap *p)
+{
+   return sizeof(SparseHeader) +
+          (p->Units + UNITS_PER_WORD - 1) / UNITS_PER_WORD * sizeof(uint32_t);
+}
+
+// The sidecar is the image's name with the extension replaced
+static void SidecarName(char *pTo,const char *Filename)
+{
+   const char *cp = SPARSE_MAP_EXT;
+
+   while(*Filename && *Filename != '.') {
+      *pTo++ = *Filename++;
+   }
+   while((*pTo++ = *cp++) != 0);
+}
+
+static int GetUnit(SparseMap *p,uint32_t Unit)
+{
+   uint32_t Word = p->pMap[Unit / UNITS_PER_WORD];
+
+   return (Word >> ((Unit % UNITS_PER_WORD) * 2)) & 3;
+}
+
+static void SetUnit(SparseMap *p,uint32_t Unit,int State)
+{
+   uint32_t *pWord = &p->pMap[Unit / UNITS_PER_WORD];
+   int Shift = (Unit % UNITS_PER_WORD) * 2;
+
+   *pWord = (*pWord & ~(3 << Shift)) | (State << Shift);
+   if(!p->bLearned && !p->bCleared) {
+      p->LastChange = ticks_ms();
+   }
+   if(State == UNIT_UNKNOWN) {
+      p->bCleared = true;
+   }
+   else {
+      p->bLearned = true;
+   }
+}
+
+// Stop using the map and remove the sidecar so a stale copy can't be used
+static void SparseDisable(SparseMap *p)
+{
+   char Sidecar[FF_SFN_BUF + 1];
+
+   ELOG("Disabling sparse map for %s\n",p->Filename);
+   p->fp = NULL;
+   SidecarName(Sidecar,p->Filename);
+   f_unlink(Sidecar);
+}
+
+static int SparseSave(SparseMap *p)
+{
+   char Sidecar[FF_SFN_BUF + 1];
+   FILINFO Info;
+   FIL File;
+   UINT Wrote;
+   FRESULT Err;
+   int Ret = 1;
+
+   do {
+      if((Err = f_stat(p->Filename,&Info)) != FR_OK) {
+         ELOG("f_stat failed: %d\n",Err);
+         break;
+      }
+      p->pHeader->fdate = Info.fdate;
+      p->pHeader->ftime = Info.ftime;
+
+      SidecarName(Sidecar,p->Filename);
+      if((Err = f_open(&File,Sidecar,FA_WRITE | FA_CREATE_ALWAYS)) != FR_OK) {
+         ELOG("Couldn't create %s, %d\n",Sidecar,Err);
+         break;
+      }
+      Err = f_write(&File,p->pHeader,MapSize(p),&Wrote);
+      if(Err != FR_OK || Wrote != MapSize(p)) {
+         ELOG("f_write failed: %d\n",Err);
+      }
+      else {
+         Ret = 0;
+      }
+      if((Err = f_close(&File)) != FR_OK) {
+         ELOG("f_close failed: %d\n",Err);
+         Ret = 1;
+      }
+   } while(false);
+
+   if(Ret == 0) {
+      VLOG("Saved %s\n",Sidecar);
+      p->bLearned = false;
+      p->bCleared = false;
+   }
+   return Ret;
+}
+
+// Set up a sparse map for an image divided into units of UnitSize bytes,
+// loading the sidecar if it's still valid.  Returns 0 on success.
+int SparseMapOpen(FIL *fp,const char *Filename,uint32_t UnitSize)
+{
+   SparseMap *p;
+   char Sidecar[FF_SFN_BUF + 1];
+   SparseHeader Header;
+   FILINFO Info;
+   FIL File;
+   UINT Read;
+   uint32_t Units = f_size(fp) / UnitSize;
+   uint32_t Blank = 0;
+   uint32_t i;
+   FRESULT Err;
+   int Ret = 1;
+
+   do {
+      if(strnlen(Filename,FF_SFN_BUF + 1) > FF_SFN_BUF) {
+         break;
+      }
+      if((p = SparseLookup(fp)) == NULL && (p = SparseLookup(NULL)) == NULL) {
+         ELOG("Internal error\n");
+         break;
+      }
+   // Allocations are never freed, reuse the buffer on a remount
+      if(p->pHeader == NULL || p->Units != Units) {
+         p->Units = Units;
+         if((p->pHeader = DdrAlloc(MapSize(p))) == NULL) {
+            break;
+         }
+         p->pMap = (uint32_t *) (p->pHeader + 1);
+      }
+      for(i = 0; (p->Filename[i] = Filename[i]) != 0; i++);
+      memset(p->pMap,0,MapSize(p) - sizeof(SparseHeader));
+      p->pHeader->Magic = SPARSE_MAP_MAGIC;
+      p->pHeader->ImageSize = f_size(fp);
+      p->pHeader->UnitSize = UnitSize;
+      p->bLearned = false;
+      p->bCleared = false;
+      p->fp = fp;
+      Ret = 0;
+
+      SidecarName(Sidecar,Filename);
+      if(f_open(&File,Sidecar,FA_READ) != FR_OK) {
+         LOG("No sparse map for %s\n",Filename);
+         break;
+      }
+      if(f_read(&File,&Header,sizeof(Header),&Read) == FR_OK &&
+         Read == sizeof(Header) &&
+         (Err = f_stat(Filename,&Info)) == FR_OK &&
+         Header.Magic == SPARSE_MAP_MAGIC &&
+         Header.ImageSize == p->pHeader->ImageSize &&
+         Header.UnitSize == UnitSize &&
+         Header.fdate == Info.fdate && Header.ftime == Info.ftime)
+      {
+         Err = f_read(&File,p->pMap,MapSize(p) - sizeof(Header),&Read);
+         if(Err != FR_OK || Read != MapSize(p) - sizeof(Header)) {
+            memset(p->pMap,0,MapSize(p) - sizeof(SparseHeader));
+         }
+      }
+      else {
+         LOG("%s is stale, ignored\n",Sidecar);
+      }
+      f_close(&File);
+
+      for(i = 0; i < Units; i++) {
+         if(GetUnit(p,i) != UNIT_UNKNOWN) {
+            Blank++;
+         }
+      }
+      LOG("%s: %d of %d units blank\n",Filename,Blank,Units);
+   } while(false);
+
+   return Ret;
+}
+
+// Return the fill byte of a blank unit or -1 if the unit must be read
+int SparseMapLookup(FIL *fp,FSIZE_t Pos)
+{
+   SparseMap *p = SparseLookup(fp);
+   int Ret = -1;
+
+   if(p != NULL) {
+      switch(GetUnit(p,Pos / p->pHeader->UnitSize)) {
+         case UNIT_E5:
+            Ret = 0xe5;
+            break;
+
+         case UNIT_ZERO:
+            Ret = 0;
+            break;
+      }
+   }
+   return Ret;
+}
+
+// Called with a unit that was just read from the image
+void SparseMapLearn(FIL *fp,FSIZE_t Pos,const uint8_t *pData,uint32_t Len)
+{
+   SparseMap *p = SparseLookup(fp);
+   const uint32_t *p32 = (const uint32_t *) pData;
+   uint32_t Fill;
+   uint32_t i;
+
+   do {
+      if(p == NULL || Len != p->pHeader->UnitSize ||
+         (Pos % p->pHeader->UnitSize) != 0 || ((uint32_t) pData & 3) != 0)
+      {
+         break;
+      }
+      Fill = p32[0];
+      if(Fill != 0xe5e5e5e5 && Fill != 0) {
+         break;
+      }
+      for(i = 1; i < Len / sizeof(uint32_t); i++) {
+         if(p32[i] != Fill) {
+            break;
+         }
+      }
+      if(i == Len / sizeof(uint32_t)) {
+         SetUnit(p,Pos / Len,Fill == 0 ? UNIT_ZERO : UNIT_E5);
+      }
+   } while(false);
+}
+
+// Called for every write to the image
+void SparseMapWrite(FIL *fp,FSIZE_t Pos)
+{
+   SparseMap *p = SparseLookup(fp);
+   uint32_t Unit;
+
+   if(p != NULL) {
+      Unit = Pos / p->pHeader->UnitSize;
+      if(GetUnit(p,Unit) != UNIT_UNKNOWN) {
+         SetUnit(p,Unit,UNIT_UNKNOWN);
+      }
+   }
+}
+
+// Called before dirty blocks are written to an image
+void SparseMapPreFlush(FIL *fp)
+{
+   SparseMap *p = SparseLookup(fp);
+
+   if(p != NULL && p->bCleared && SparseSave(p) != 0) {
+      SparseDisable(p);
+   }
+}
+
+// Called after an image has been synced.  Writes through FatFs update the
+// image's timestamp so the sidecar must be saved again to remain valid.
+void SparseMapSynced(FIL *fp)
+{
+   SparseMap *p = SparseLookup(fp);
+   FILINFO Info;
+
+   if(p != NULL && f_stat(p->Filename,&Info) == FR_OK &&
+      (p->bLearned || p->bCleared || Info.fdate != p->pHeader->fdate ||
+       Info.ftime != p->pHeader->ftime))
+   {
+      if(SparseSave(p) != 0) {
+         SparseDisable(p);
+      }
+   }
+}
+
+// Save maps which have learned new blank units once things have been quiet
+// for a while
+void SparseMapPoll()
+{
+   SparseMap *p = gMaps;
+   int i;
+
+   for(i = 0; i < MAX_MOUNTED_DRIVES + 1; i++, p++) {
+      if(p->fp != NULL && (p->bLearned || p->bCleared) &&
+         ticks_ms() - p->LastChange >= SPARSE_SAVE_DELAY)
+      {
+         if(SparseSave(p) != 0) {
+            SparseDisable(p);
+         }
+      }
+   }
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 3
+ * End:
+ */
@@ -0,0 +1,37 @@
+/*
+ *  sparse_map.h
+ *
+ *  Copyright (C) 2020  Skip Hansen
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms and conditions of the GNU General Public License,
+ *  version 2, as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ *  more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#ifndef _SPARSE_MAP_H_
+#define _SPARSE_MAP_H_
+
+#include "ff.h"
+
+#define SPARSE_MAP_EXT        ".MAP"
+#define SPARSE_MAP_MAGIC      0x314d5053  // "SPM1"
+#define SPARSE_SAVE_DELAY     5000        // ms after the last change
+
+int SparseMapOpen(FIL *fp,const char *Filename,uint32_t UnitSize);
+int SparseMapLookup(FIL *fp,FSIZE_t Pos);
+void SparseMapLearn(FIL *fp,FSIZE_t Pos,const uint8_t *pData,uint32_t Len);
+void SparseMapWrite(FIL *fp,FSIZE_t Pos);
+void SparseMapPreFlush(FIL *fp);
+void SparseMapSynced(FIL *fp);
+void SparseMapPoll(void);
+
+#endif   // _SPARSE_MAP_H_
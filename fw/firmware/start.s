@@ -10,11 +10,53 @@ nop
 nop
 nop
 
+# Without the IRQ q registers the PicoRV32 puts the return address in gp
+# and the pending interrupts in tp.  The firmware is linked --no-relax
+# and doesn't use either register.
 irq:
-#.word 0x0000450B
+addi sp, sp, -64
+sw ra, 0(sp)
+sw t0, 4(sp)
+sw t1, 8(sp)
+sw t2, 12(sp)
+sw a0, 16(sp)
+sw a1, 20(sp)
+sw a2, 24(sp)
+sw a3, 28(sp)
+sw a4, 32(sp)
+sw a5, 36(sp)
+sw a6, 40(sp)
+sw a7, 44(sp)
+sw t3, 48(sp)
+sw t4, 52(sp)
+sw t5, 56(sp)
+sw t6, 60(sp)
+
 addi a0, gp, 0
+addi a1, tp, 0
 call irq_handler
 
+lw ra, 0(sp)
+lw t0, 4(sp)
+lw t1, 8(sp)
+lw t2, 12(sp)
+lw a0, 16(sp)
+lw a1, 20(sp)
+lw a2, 24(sp)
+lw a3, 28(sp)
+lw a4, 32(sp)
+lw a5, 36(sp)
+lw a6, 40(sp)
+lw a7, 44(sp)
+lw t3, 48(sp)
+lw t4, 52(sp)
+lw t5, 56(sp)
+lw t6, 60(sp)
+addi sp, sp, 64
+
+# retirq
+.word 0x0400000B
+
 boot:
 # zero-initialize register file
 addi x1, zero, 0
@@ -251,9 +251,25 @@ void usb_event_poll(void);
 
 // USB Mass stoarge device
 #define USB_MAX_STOR_DEV 1
+// Largest single bulk transfer passed to the host controller driver, 
+// the ISP1760 driver pipelines anything larger than one payload buffer
+#define USB_STOR_BULK_MAX  (64 * 1024)
+
+// Bulk only transport timing, times are totals in microseconds
+typedef struct {
+   uint32_t Commands;
+   uint32_t Errors;
+   uint32_t DataBytes;
+   uint32_t CommandUs;  // CBW phase
+   uint32_t DataUs;     // data phase
+   uint32_t StatusUs;   // CSW phase
+} UsbStorStats;
+extern UsbStorStats gUsbStorStats;
+
 block_dev_desc_t *usb_stor_get_dev(int index);
 int usb_stor_scan(int mode);
 int usb_stor_info(void);
+void usb_stor_dump_stats(void);
 
 // USB Keyboard
 extern unsigned char gCapsLockSwap;
@@ -262,6 +278,7 @@ int drv_usb_kbd_init(void);
 int usb_kbd_deregister(void);
 int usb_kbd_testc(void);
 char usb_kbd_getc(void);
+int usb_kbd_putc(char data);
 
 // USB Game pad
 int drv_usb_gp_init(void);
@@ -173,6 +173,21 @@ static void usb_kbd_put_queue(char data)
    return;
 }
 
+/* queues a character from another source, returns 0 if the queue is full */
+int usb_kbd_putc(char data)
+{
+   int next = usb_in_pointer + 1;
+
+   if(next == USB_KBD_BUFFER_LEN) {
+      next = 0;
+   }
+   if(next == usb_out_pointer) {
+      return 0;
+   }
+   usb_kbd_put_queue(data);
+   return 1;
+}
+
 /* test if a character is in the queue */
 int usb_kbd_testc(void)
 {
@@ -156,10 +156,15 @@ struct us_data {
    ccb      *srb;       /* current srb */
    trans_reset transport_reset;  /* reset routine */
    trans_cmnd  transport;     /* transport routine */
+   unsigned int   pipe_in;    /* bulk in pipe */
+   unsigned int   pipe_out;   /* bulk out pipe */
+   unsigned char  ready;      /* TEST UNIT READY has succeeded */
 };
 
 static struct us_data usb_stor[USB_MAX_STOR_DEV];
 
+UsbStorStats gUsbStorStats;
+
 
 #define USB_STOR_TRANSPORT_GOOD     0
 #define USB_STOR_TRANSPORT_FAILED -1
@@ -468,7 +473,7 @@ int usb_stor_BBB_comdat(ccb *srb, struct us_data *us)
    }
 
    /* always OUT to the ep */
-   pipe = usb_sndbulkpipe(us->pusb_dev, us->ep_out);
+   pipe = us->pipe_out;
 
    cbw.dCBWSignature = cpu_to_le32(CBWSIGNATURE);
    cbw.dCBWTag = cpu_to_le32(CBWTag++);
@@ -621,26 +626,34 @@ int usb_stor_BBB_transport(ccb *srb, struct us_data *us)
    int result, retry;
    int dir_in;
    int actlen, data_actlen;
-   unsigned int pipe, pipein, pipeout;
+   int chunk, chunk_actlen;
+   unsigned int pipe, pipein;
    umass_bbb_csw_t csw;
+   uint32_t start_us = ticks_us();
+   uint32_t now_us;
 #ifdef BBB_XPORT_TRACE
    unsigned char *ptr;
    int index;
 #endif
 
    dir_in = US_DIRECTION(srb->cmd[0]);
+   gUsbStorStats.Commands++;
 
    /* COMMAND phase */
    LOG("COMMAND phase\n");
    result = usb_stor_BBB_comdat(srb, us);
+   now_us = ticks_us();
+   gUsbStorStats.CommandUs += now_us - start_us;
+   start_us = now_us;
    if (result < 0) {
       ELOG("\nfailed to send CBW status %ld\n",us->pusb_dev->status);
       usb_stor_BBB_reset(us);
       return USB_STOR_TRANSPORT_FAILED;
    }
-   delay_ms(5);
-   pipein = usb_rcvbulkpipe(us->pusb_dev, us->ep_in);
-   pipeout = usb_sndbulkpipe(us->pusb_dev, us->ep_out);
+   /* No delay is needed here, the data phase's bulk transfer polls for 
+    * completion and retries while the device NAKs
+    */
+   pipein = us->pipe_in;
    /* DATA phase + error handling */
    data_actlen = 0;
    /* no data, go immediately to the STATUS phase */
@@ -650,9 +663,25 @@ int usb_stor_BBB_transport(ccb *srb, struct us_data *us)
    if (dir_in)
       pipe = pipein;
    else
-      pipe = pipeout;
-   result = usb_bulk_msg(us->pusb_dev, pipe, srb->pdata, srb->datalen,
-               &data_actlen, USB_CNTL_TIMEOUT * 5);
+      pipe = us->pipe_out;
+   /* Split very large transfers into several bulk transfers, stop on a
+    * short packet
+    */
+   do {
+      chunk = srb->datalen - data_actlen;
+      if (chunk > USB_STOR_BULK_MAX)
+         chunk = USB_STOR_BULK_MAX;
+      chunk_actlen = 0;
+      result = usb_bulk_msg(us->pusb_dev, pipe, srb->pdata + data_actlen,
+                  chunk, &chunk_actlen, USB_CNTL_TIMEOUT * 5);
+      if (result < 0)
+         break;
+      data_actlen += chunk_actlen;
+   } while (chunk_actlen == chunk && data_actlen < srb->datalen);
+   now_us = ticks_us();
+   gUsbStorStats.DataUs += now_us - start_us;
+   gUsbStorStats.DataBytes += data_actlen;
+   start_us = now_us;
    /* special handling of STALL in DATA phase */
    if ((result < 0) && (us->pusb_dev->status & USB_ST_STALLED)) {
       ELOG("\nDATA:stall\n");
@@ -690,6 +719,7 @@ again:
          /* do a retry */
          goto again;
    }
+   gUsbStorStats.StatusUs += ticks_us() - start_us;
    if (result < 0) {
       ELOG("usb_bulk_msg error status %ld\n",
          us->pusb_dev->status);
@@ -981,16 +1011,29 @@ static void usb_bin_fixup(struct usb_device_descriptor descriptor,
 }
 #endif /* CONFIG_USB_BIN_FIXUP */
 
-#define USB_MAX_READ_BLK 20
-#define USB_MAX_WRITE_BLK 20
+#define USB_MAX_READ_BLK 256
+#define USB_MAX_WRITE_BLK 256
+
+/* Return the cached transport data for a device, the device list is only
+ * walked by usb_stor_scan()
+ */
+static struct us_data *usb_stor_get_us(int device)
+{
+   if (device < 0 || device >= usb_max_devs || 
+       usb_stor[device].pusb_dev == NULL) {
+      ELOG("Error - Device not found\n");
+      return NULL;
+   }
+   return &usb_stor[device];
+}
 
 unsigned long usb_stor_read(int device, unsigned long blknr,
              unsigned long blkcnt, void *buffer)
 {
    unsigned long start, blks, buf_addr;
    unsigned short smallblks;
-   struct usb_device *dev;
-   int retry, i;
+   struct us_data *ss;
+   int retry;
    ccb *srb = &usb_ccb;
    int Err;
 
@@ -1000,28 +1043,24 @@ unsigned long usb_stor_read(int device, unsigned long blknr,
    device &= 0xff;
    /* Setup  device */
    LOG("\nusb_read: dev %d \n", device);
-   dev = NULL;
-   for (i = 0; i < USB_MAX_DEVICE; i++) {
-      dev = usb_get_dev_index(i);
-      if (dev == NULL) {
-         ELOG("Error - Device not found\n");
-         return 0;
-      }
-      if (dev->devnum == usb_dev_desc[device].target)
-         break;
-   }
+   if ((ss = usb_stor_get_us(device)) == NULL)
+      return 0;
 
-   usb_disable_asynch(1); /* asynch transfer not allowed */
    srb->lun = usb_dev_desc[device].lun;
    buf_addr = (unsigned long)buffer;
    start = blknr;
    blks = blkcnt;
-   if (usb_test_unit_ready(srb, (struct us_data *)dev->privptr)) {
-      ELOG("Device NOT ready\n   Request Sense returned %02X %02X"
-             " %02X\n", srb->sense_buf[2], srb->sense_buf[12],
-             srb->sense_buf[13]);
-      return 0;
+   /* Only poll the unit until it's ready once, not on every read */
+   if (!ss->ready) {
+      if (usb_test_unit_ready(srb, ss)) {
+         ELOG("Device NOT ready\n   Request Sense returned %02X %02X"
+                " %02X\n", srb->sense_buf[2], srb->sense_buf[12],
+                srb->sense_buf[13]);
+         return 0;
+      }
+      ss->ready = 1;
    }
+   usb_disable_asynch(1); /* asynch transfer not allowed */
 
    LOG("\nusb_read: dev %d startblk %lx, blccnt %lx"
          " buffer %lx\n", device, start, blks, buf_addr);
@@ -1039,10 +1078,12 @@ retry_it:
          usb_show_progress();
       srb->datalen = usb_dev_desc[device].blksz * smallblks;
       srb->pdata = (unsigned char *)buf_addr;
-      Err = usb_read_10(srb,(struct us_data *)dev->privptr,start,smallblks);
+      Err = usb_read_10(srb,ss,start,smallblks);
       if(Err != 0) {
          ELOG("\nRead ERROR, usb_read_10 returned %d\n",Err);
-         usb_request_sense(srb, (struct us_data *)dev->privptr);
+         gUsbStorStats.Errors++;
+         ss->ready = 0;
+         usb_request_sense(srb, ss);
          ELOG("Request Sense returned %02X %02X %02X\n",
                srb->sense_buf[2], srb->sense_buf[12],
                srb->sense_buf[13]);
@@ -1073,28 +1114,17 @@ static unsigned long usb_stor_write(int device, unsigned long blknr,
    unsigned long start, blks;
    uintptr_t buf_addr;
    unsigned short smallblks;
-   struct usb_device *udev;
    int retry;
    ccb *srb = &usb_ccb;
-   struct usb_device *dev;
-   int i;
+   struct us_data *ss;
 
    if (blkcnt == 0)
       return 0;
 
    /* Setup  device */
    LOG("\nusb_write: dev %d \n", device);
-   dev = NULL;
-   for (i = 0; i < USB_MAX_DEVICE; i++) {
-      dev = usb_get_dev_index(i);
-      if (dev == NULL) {
-         ELOG("Error - Device not found\n");
-         return 0;
-      }
-      if (dev->devnum == usb_dev_desc[device].target)
-         break;
-   }
-   // ss = (struct us_data *)udev->privptr;
+   if ((ss = usb_stor_get_us(device)) == NULL)
+      return 0;
 
    usb_disable_asynch(1); /* asynch transfer not allowed */
 
@@ -1121,9 +1151,10 @@ retry_it:
          usb_show_progress();
       srb->datalen = usb_dev_desc[device].blksz * smallblks;
       srb->pdata = (unsigned char *)buf_addr;
-      if (usb_write_10(srb, (struct us_data *)dev->privptr, start, smallblks)) {
+      if (usb_write_10(srb, ss, start, smallblks)) {
          ELOG("Write ERROR\n");
-         usb_request_sense(srb, (struct us_data *)dev->privptr);
+         gUsbStorStats.Errors++;
+         usb_request_sense(srb, ss);
          ELOG("Request Sense returned %02X %02X %02X\n",
                srb->sense_buf[2], srb->sense_buf[12],
                srb->sense_buf[13]);
@@ -1136,7 +1167,6 @@ retry_it:
       blks -= smallblks;
       buf_addr += srb->datalen;
    } while (blks != 0);
-   // ss->flags &= ~USB_READY;
 
    LOG("usb_write: end startblk %lx, blccnt %x buffer %lx\n",
          start, smallblks, buf_addr);
@@ -1284,6 +1314,8 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
       ss->irqmaxp = usb_maxpacket(dev, ss->irqpipe);
       dev->irq_handle = usb_stor_irq;
    }
+   ss->pipe_in = usb_rcvbulkpipe(dev, ss->ep_in);
+   ss->pipe_out = usb_sndbulkpipe(dev, ss->ep_out);
    dev->privptr = (void *)ss;
    return 1;
 }
@@ -1369,6 +1401,7 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
       }
       return 0;
    }
+   ss->ready = 1;
    pccb->pdata = (unsigned char *)&cap[0];
    memset(pccb->pdata, 0, 8);
    if (usb_read_capacity(pccb, ss) != 0) {
@@ -1396,4 +1429,15 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
    return 1;
 }
 
-
+void usb_stor_dump_stats(void)
+{
+   UsbStorStats *p = &gUsbStorStats;
+
+   ALOG_R("USB storage: %d commands, %d errors, %d bytes\n",p->Commands,
+          p->Errors,p->DataBytes);
+   if(p->Commands != 0) {
+      ALOG_R("  avg us/command: command %d, data %d, status %d\n",
+             p->CommandUs / p->Commands,p->DataUs / p->Commands,
+             p->StatusUs / p->Commands);
+   }
+}
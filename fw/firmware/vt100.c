@@ -949,6 +949,27 @@ STATE(_st_idle, term, ev, arg)
    }
 }
 
+// Write a batch of characters.  Runs of printable characters are drawn 
+// directly and the cursor is only redrawn at the end of the run.
+void vt100_write(const uint8_t *buf,int len)
+{
+   while(len > 0) {
+#if !defined(ECHO_CONSOLE_2_SERIAL) && !defined(VERBOSE_DEBUG_LOGGING)
+      if(term.state == _st_idle && *buf >= ' ' && *buf < KEY_DEL) {
+         _vt100_removeCursor(&term);
+         while(len > 0 && *buf >= ' ' && *buf < KEY_DEL) {
+            _vt100_putc(&term,*buf++);
+            len--;
+         }
+         _vt100_drawCursor(&term);
+         continue;
+      }
+#endif
+      vt100_putc(*buf++);
+      len--;
+   }
+}
+
 void vt100_init()
 {
    _vt100_reset(); 
@@ -36,6 +36,7 @@ extern "C" {
 void vt100_init(void);
 void vt100_putc(uint8_t ch);
 void vt100_puts(const char *str);
+void vt100_write(const uint8_t *buf,int len);
 
 #ifdef __cplusplus
 }
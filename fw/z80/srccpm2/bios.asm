@@ -65,6 +65,12 @@ FDCOP   EQU     13              ;fdc-port: command
 FDCST   EQU     14              ;fdc-port: status
 DMAL    EQU     15              ;dma-port: dma address low
 DMAH    EQU     16              ;dma-port: dma address high
+FDCCNT  EQU     18              ;fdc-port: # of sectors for multi-sector ops
+;
+;       fdc commands
+;
+FDCRDM  EQU     2               ;read FDCCNT sectors
+FDCRDS  EQU     6               ;FDCRDM from the firmware's system track copy
 ;
         ORG     BIOS            ;origin of this program
 ;
@@ -177,41 +183,27 @@ WBOOT:  LD      SP,80H          ;use space below buffer for stack
         CALL    SELDSK
         CALL    HOME            ;go to track 00
 ;
-        LD      B,NSECTS        ;b counts # of sectors to load
-        LD      C,0             ;c has the current track number
-        LD      D,2             ;d has the next sector to read
+        LD      C,2             ;begin with sector 2
 ;       note that we begin by reading track 0, sector 2 since sector 1
 ;       contains the cold start loader, which is skipped in a warm start
-        LD      HL,CCP          ;base of cp/m (initial load point)
-LOAD1:                          ;load one more sector
-        PUSH    BC              ;save sector count, current track
-        PUSH    DE              ;save next sector to read
-        PUSH    HL              ;save dma address
-        LD      C,D             ;get sector address to register c
-        CALL    SETSEC          ;set sector address from register c
-        POP     BC              ;recall dma address to b,c
-        PUSH    BC              ;replace on stack for later recall
-        CALL    SETDMA          ;set dma address from b,c
-;       drive set to 0, track set, sector set, dma address set
-        CALL    READ
+        CALL    SETSEC
+        LD      BC,CCP          ;base of cp/m (initial load point)
+        CALL    SETDMA
+        LD      A,NSECTS        ;# of sectors to load
+        OUT     (FDCCNT),A
+;       drive set to 0, track set, sector set, dma address set, count set
+        LD      A,FDCRDS        ;restore all of them with one command
+        CALL    WAITIO
+        OR      A               ;any errors?
+        JP      Z,GOCPM         ;no, transfer to cp/m
+        LD      A,FDCRDM        ;older firmware, read them from the disk
+        CALL    WAITIO
         OR      A               ;any errors?
-        JP      Z,LOAD2         ;no, continue
+        JP      Z,GOCPM         ;no, transfer to cp/m
         LD      HL,LDERR        ;error, print message
         CALL    PRTMSG
         DI                      ;and halt the machine
         HALT
-;       no error, move to next sector
-LOAD2:  POP     HL              ;recall dma address
-        LD      DE,128          ;dma=dma+128
-        ADD     HL,DE           ;new dma address is in h,l
-        POP     DE              ;recall sector address
-        POP     BC              ;recall number of sectors remaining,
-                                ;and current trk
-        DEC     B               ;sectors=sectors-1
-        JP      Z,GOCPM         ;transfer to cp/m if all have been loaded
-;       more sectors remain to load, check for track change
-        INC     D
-        JP      LOAD1           ;for another sector
 ;       end of load operation, set parameters and go to cp/m
 GOCPM:
         LD      A,0C3H          ;c3 is a jmp instruction
@@ -28,6 +28,11 @@ FDCOP   EQU     13              ;fdc-port: command
 FDCST   EQU     14              ;fdc-port: status
 DMAL    EQU     15              ;dma-port: dma address low
 DMAH    EQU     16              ;dma-port: dma address high
+SECCNT  EQU     18              ;fdc-port: # of sectors for multi-sector ops
+;
+;       fdc commands
+;
+RDMULT  EQU     2               ;read SECCNT sectors
 ;
         JP      COLD
 ;
@@ -36,27 +41,26 @@ ERRMSG: DEFM    'BOOT: error booting'
 ;
 ;       begin the load operation
 ;
-COLD:   LD      BC,2            ;b=track 0, c=sector 2
-        LD      D,SECTS         ;d=# sectors to load
-        LD      HL,CCP          ;base transfer address
-        XOR     A               ;select drive A
+COLD:   XOR     A               ;select drive A
         OUT     (DRIVE),A
-;
-;       load the next sector
-;
-LSECT:  LD      A,B             ;set track
-        OUT     (TRACK),A
-        LD      A,C             ;set sector
+        OUT     (TRACK),A       ;track 0
+        LD      A,2             ;sector 2
         OUT     (SECTOR),A
+        LD      HL,CCP          ;base transfer address
         LD      A,L             ;set dma address low
         OUT     (DMAL),A
         LD      A,H             ;set dma address high
         OUT     (DMAH),A
-        XOR     A               ;read sector
+        LD      A,SECTS         ;# sectors to load
+        OUT     (SECCNT),A
+;
+;       load the whole system with a single command
+;
+        LD      A,RDMULT        ;read sectors
         OUT     (FDCOP),A
         IN      A,(FDCST)       ;get status of fdc
         OR      A               ;read successful ?
-        JP      Z,CONT          ;yes, continue
+        JP      Z,BOOT          ;yes, head for the bios
         LD      HL,ERRMSG       ;no, print error
 PRTMSG: LD      A,(HL)
         OR      A
@@ -66,22 +70,5 @@ PRTMSG: LD      A,(HL)
         JP      PRTMSG
 STOP:   DI
         HALT                    ;and halt cpu
-;
-CONT:
-                                ;go to next sector if load is incomplete
-        DEC     D               ;sects=sects-1
-        JP      Z,BOOT          ;head for the bios
-;
-;       more sectors to load
-;
-;       we aren't using a stack, so use <sp> as scratch register
-;       to hold the load address increment
-;
-        LD      SP,128          ;128 bytes per sector
-        ADD     HL,SP           ;<hl> = <hl> + 128
-;
-        INC     C               ;sector = sector + 1
-        LD      A,C
-        JP      LSECT           ;for another group
 ;
         END                     ;of boot loader